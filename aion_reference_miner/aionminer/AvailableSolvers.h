@@ -23,6 +23,11 @@ public:
 	}
 	virtual ~CPUSolverTromp() {
 	}
+#ifdef USE_CPU_TROMP
+	virtual uint64_t getmemory() override {
+		return _context->memory.load(std::memory_order_relaxed);
+	}
+#endif
 };
 // TODO remove platform id for cuda solvers
 // CUDA solvers
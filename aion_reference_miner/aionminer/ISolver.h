@@ -18,12 +18,14 @@ public:
 			unsigned int tequihash_header_len, const char* nonce,
 			unsigned int nonce_len, std::function<bool()> cancelf,
 			std::function<
-					void(const std::vector<uint32_t>&, size_t,
+					void(const uint32_t*, size_t,
 							const unsigned char*)> solutionf,
 			std::function<void(void)> hashdonef) = 0;
 
 	virtual std::string getdevinfo() = 0;
 	virtual std::string getname() = 0;
 	virtual SolverType GetType() const = 0;
+	// Bytes the last run allocated, 0 if the solver does not tell
+	virtual uint64_t getmemory() { return 0; }
 };
 
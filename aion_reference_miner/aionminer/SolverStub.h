@@ -22,7 +22,7 @@ struct NAME { \
         const char* nonce, \
         unsigned int nonce_len, \
         std::function<bool()> cancelf, \
-        std::function<void(const std::vector<uint32_t>&, size_t, const unsigned char*)> solutionf, \
+        std::function<void(const uint32_t*, size_t, const unsigned char*)> solutionf, \
         std::function<void(void)> hashdonef, \
         NAME& device_context)  {} \
     std::string getname() { return STUB_NAME; } \
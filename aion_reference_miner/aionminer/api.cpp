@@ -1,6 +1,8 @@
 #include <iostream>
 #include <chrono>
 #include <mutex>
+#include <sstream>
+#include <vector>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include <boost/log/trivial.hpp>
@@ -11,24 +13,70 @@
 #include "speed.hpp"
 
 
-API::API(std::shared_ptr<boost::asio::io_service> io_service)
-	: m_io_service(io_service), m_acceptor(*io_service), m_socket(*io_service)
+static void WriteStatus(std::stringstream& ss, bool histograms);
+
+
+API::API()
+	: m_io_service(std::make_shared<boost::asio::io_service>()),
+	m_work(new boost::asio::io_service::work(*m_io_service)),
+	m_acceptor(*m_io_service), m_socket(*m_io_service)
 {
+	m_commands["status"] = [](const StratumField& params, const Reply& reply)
+	{
+		BOOST_LOG_CUSTOM(debug) << "Responding to status request";
+		std::stringstream ss;
+		WriteStatus(ss, false);
+		reply(ss.str(), "");
+	};
+	m_commands["dump_stats"] = [](const StratumField& params, const Reply& reply)
+	{
+		BOOST_LOG_CUSTOM(debug) << "Responding to dump_stats request";
+		std::stringstream ss;
+		WriteStatus(ss, true);
+		reply(ss.str(), "");
+	};
 }
 
 
 API::~API()
 {
-	m_acceptor.close();
+	m_work.reset();
+	m_io_service->stop();
+	if (m_thread.joinable())
+		m_thread.join();
+	boost::system::error_code ec;
+	m_acceptor.close(ec);
 }
 
 
-bool API::start(int local_port)
+void API::addCommand(const std::string& method, const Command& command)
 {
-	boost::asio::ip::tcp::endpoint endp(boost::asio::ip::address_v4::from_string("127.0.0.1"), local_port);
+	m_commands[method] = command;
+}
+
+
+bool API::call(const std::string& method, const StratumField& params, const Reply& reply) const
+{
+	auto it = m_commands.find(method);
+	if (it == m_commands.end())
+		return false;
+	it->second(params, reply);
+	return true;
+}
+
+
+bool API::start(int local_port, const std::string& address)
+{
+	boost::system::error_code ec;
+	boost::asio::ip::address ip = boost::asio::ip::address::from_string(address, ec);
+	if (ec)
+	{
+		BOOST_LOG_CUSTOM(info) << "Invalid address " << address << " err: " << ec;
+		return false;
+	}
+	boost::asio::ip::tcp::endpoint endp(ip, local_port);
 	m_acceptor.open(endp.protocol());
 	m_acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
-	boost::system::error_code ec;
 	m_acceptor.bind(endp, ec);
 
 	if (ec)
@@ -40,25 +88,26 @@ bool API::start(int local_port)
 	m_acceptor.listen();
 	do_accept();
 
-	BOOST_LOG_CUSTOM(info) << "Listening on port " << local_port;
-
-	return true;
-}
+	m_thread = std::thread([this]()
+	{
+		for (;;)
+		{
+			try
+			{
+				m_io_service->run();
+				return;
+			}
+			catch (std::exception& ex)
+			{
+				BOOST_LOG_CUSTOM(error) << ex.what();
+			}
+		}
+	});
 
+	BOOST_LOG_CUSTOM(info) << "Listening on " << address << ":" << local_port
+		<< ", OpenMetrics at /metrics";
 
-bool API::poll()
-{
-	try
-	{
-		boost::system::error_code ec;
-		if (m_io_service->poll(ec) > 0) return true;
-		else return false;
-	}
-	catch (std::exception& ex)
-	{
-		BOOST_LOG_CUSTOM(error) << ex.what();
-		return false;
-	}
+	return true;
 }
 
 
@@ -78,7 +127,7 @@ void API::do_accept()
 		{
 			BOOST_LOG_CUSTOM(debug) << "Accepted " << m_socket.remote_endpoint();
 
-			std::shared_ptr<Client> c(new Client(std::move(m_socket)));
+			std::shared_ptr<Client> c(new Client(*this, std::move(m_socket)));
 			c->Start();
 		}
 
@@ -87,8 +136,9 @@ void API::do_accept()
 }
 
 
-Client::Client(boost::asio::ip::tcp::socket socket)
-	: m_socket(std::move(socket))
+Client::Client(const API& api, boost::asio::ip::tcp::socket socket)
+	: m_api(api), m_socket(std::move(socket)), m_response_buffer(API_MAX_LINE),
+	m_closing(false), m_pending(0)
 {
 }
 
@@ -98,7 +148,38 @@ Client::~Client()
 }
 
 
+void Client::ReadHeader(const boost::system::error_code& ec, std::size_t bytes_transferred)
+{
+	if (ec)
+	{
+		BOOST_LOG_CUSTOM(debug) << "Connection lost";
+		Close();
+		return;
+	}
+	if (bytes_transferred)
+	{
+		std::istream is(&m_response_buffer);
+		std::string line;
+		std::getline(is, line);
+		if (line.empty() || line == "\r")
+		{
+			ServeHttp();
+			return;
+		}
+	}
+	boost::asio::async_read_until(m_socket, m_response_buffer, "\n",
+		boost::bind(&Client::ReadHeader, shared_from_this(),
+		boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+}
+
+
 void Client::Start()
+{
+	Read();
+}
+
+
+void Client::Read()
 {
 	boost::asio::async_read_until(m_socket, m_response_buffer, "\n",
 		boost::bind(&Client::ReadResponse, shared_from_this(),
@@ -108,67 +189,479 @@ void Client::Start()
 
 void Client::ReadResponse(const boost::system::error_code& ec, std::size_t bytes_transferred)
 {
-	if (!ec && bytes_transferred)
+	if (ec)
 	{
-		std::istream is(&m_response_buffer);
-		std::string line;
-		std::getline(is, line);
+		if (ec == boost::asio::error::not_found)
+		{
+			BOOST_LOG_CUSTOM(debug) << "Request longer than " << API_MAX_LINE << " bytes";
+			Close();
+			return;
+		}
+		BOOST_LOG_CUSTOM(debug) << "Connection lost";
+		// Answers still on their way go out before the socket closes
+		m_closing = true;
+		if (m_write_queue.empty() && !m_pending)
+			Close();
+		return;
+	}
 
-		if (line.back() == '\r') line.pop_back();
+	std::istream is(&m_response_buffer);
+	std::string line;
+	std::getline(is, line);
 
-		BOOST_LOG_CUSTOM(trace) << "Received: " << line;
+	if (!line.empty() && line.back() == '\r') line.pop_back();
 
-		if (Parse(line))
-			Start();
+	BOOST_LOG_CUSTOM(trace) << "Received: " << line;
+
+	// A scraper, the request line is "GET <path> HTTP/1.x"
+	if (line.compare(0, 4, "GET ") == 0)
+	{
+		m_path = line.substr(4, line.find(' ', 4) - 4);
+		ReadHeader(boost::system::error_code(), 0);
+		return;
 	}
-	else if (ec)
+
+	if (!line.empty())
+		Parse(line);
+	Read();
+}
+
+
+static std::string JsonString(const std::string& value)
+{
+	static const char hex[] = "0123456789abcdef";
+	std::string out = "\"";
+	for (char c : value)
 	{
-		BOOST_LOG_CUSTOM(debug) << "Connection lost";
+		if (c == '\n')
+			out += "\\n";
+		else if ((unsigned char)c < 0x20)
+		{
+			out += "\\u00";
+			out += hex[(c >> 4) & 0xf];
+			out += hex[c & 0xf];
+		}
+		else
+		{
+			if (c == '"' || c == '\\')
+				out += '\\';
+			out += c;
+		}
 	}
+	return out + "\"";
 }
 
 
-bool Client::Parse(const std::string& request)
+// Percentiles in milliseconds
+static void WriteHistogram(std::stringstream& ss, const LatencyHistogram& histogram)
 {
-	std::stringstream ss;
-	ss << "{\"method\":\"" << request << "\",\"result\":";
+	ss << "{\"count\":" << histogram.Count() << ",";
+	ss << "\"mean\":" << histogram.Mean() / 1000 << ",";
+	ss << "\"min\":" << histogram.Min() / 1000.0 << ",";
+	ss << "\"p50\":" << histogram.Percentile(50) / 1000.0 << ",";
+	ss << "\"p90\":" << histogram.Percentile(90) / 1000.0 << ",";
+	ss << "\"p99\":" << histogram.Percentile(99) / 1000.0 << ",";
+	ss << "\"p999\":" << histogram.Percentile(99.9) / 1000.0 << ",";
+	ss << "\"max\":" << histogram.Max() / 1000.0 << "}";
+}
+
 
-	if (request == "status")
+static void WriteSolvers(std::stringstream& ss)
+{
+	ss << "[";
+	for (size_t i = 0; i < speed.GetSolverCount(); ++i)
 	{
-		BOOST_LOG_CUSTOM(debug) << "Responding to status request";
+		std::shared_ptr<SolverStats> solver = speed.GetSolver(i);
+		if (!solver)
+			continue;
+		ss << (i ? ",{" : "{");
+		ss << "\"index\":" << i << ",";
+		ss << "\"name\":" << JsonString(solver->name) << ",";
+		ss << "\"device\":" << JsonString(solver->device) << ",";
+		ss << "\"speed_ips\":" << speed.GetSolverHashSpeed(*solver) << ",";
+		ss << "\"speed_sps\":" << speed.GetSolverSolutionSpeed(*solver) << ",";
+		ss << "\"speed_ips_60s\":" << speed.GetSolverHashSpeed(*solver, SPEED_WINDOW_MEDIUM) << ",";
+		ss << "\"shares\":" << solver->shares << ",";
+		ss << "\"wasted\":" << solver->wasted << ",";
+		ss << "\"wasted_ms\":" << solver->wasted_ms << ",";
+		ss << "\"paused\":" << (solver->paused ? "true" : "false") << ",";
+		ss << "\"solve_time_ms\":";
+		WriteHistogram(ss, solver->solve_time);
+		ss << "}";
+	}
+	ss << "]";
+}
+
+static void WritePools(std::stringstream& ss)
+{
+	ss << "[";
+	for (size_t i = 0; i < speed.GetPoolCount(); ++i)
+	{
+		std::shared_ptr<PoolStats> pool = speed.GetPool(i);
+		if (!pool)
+			continue;
+		ss << (i ? ",{" : "{");
+		ss << "\"index\":" << i << ",";
+		ss << "\"name\":" << JsonString(pool->name) << ",";
+		ss << "\"source\":" << pool->source << ",";
+		ss << "\"weight\":" << pool->weight << ",";
+		ss << "\"active\":" << (pool->active ? "true" : "false") << ",";
+		ss << "\"seconds\":" << speed.GetPoolSeconds(*pool) << ",";
+		ss << "\"speed_ips\":" << speed.GetPoolHashSpeed(*pool) << ",";
+		ss << "\"speed_ips_60s\":" << speed.GetPoolHashSpeed(*pool, SPEED_WINDOW_MEDIUM) << ",";
+		ss << "\"shares\":" << pool->shares;
+		ss << "}";
+	}
+	ss << "]";
+}
+
+
+// Histogram buckets of the metrics in microseconds, 100 us to a minute
+static const uint64_t MetricBounds[] = {
+	100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000,
+	500000, 1000000, 2500000, 5000000, 10000000, 30000000, 60000000 };
+#define METRIC_BOUNDS (sizeof(MetricBounds) / sizeof(MetricBounds[0]))
+
+static std::string MetricLabel(const std::string& value)
+{
+	std::string out = "\"";
+	for (char c : value)
+	{
+		if (c == '\n')
+			out += "\\n";
+		else
+		{
+			if (c == '"' || c == '\\')
+				out += '\\';
+			out += c;
+		}
+	}
+	return out + "\"";
+}
+
+static void MetricFamily(std::ostream& out, const char* name, const char* type, const char* help)
+{
+	out << "# TYPE " << name << " " << type << "\n";
+	out << "# HELP " << name << " " << help << "\n";
+}
+
+// Samples of one histogram in seconds
+static void WriteMetricHistogram(std::ostream& out, const char* name,
+	const std::string& labels, const LatencyHistogram& histogram)
+{
+	std::string bucket = labels.empty() ? "_bucket{le=\"" : "_bucket{" + labels + ",le=\"";
+	std::string set = labels.empty() ? "" : "{" + labels + "}";
+	uint64_t counts[METRIC_BOUNDS];
+	uint64_t total = histogram.Cumulative(MetricBounds, METRIC_BOUNDS, counts);
+	for (size_t i = 0; i < METRIC_BOUNDS; i++)
+		out << name << bucket << MetricBounds[i] / 1000000.0 << "\"} " << counts[i] << "\n";
+	out << name << bucket << "+Inf\"} " << total << "\n";
+	out << name << "_count" << set << " " << total << "\n";
+	out << name << "_sum" << set << " " << histogram.Sum() / 1000000.0 << "\n";
+}
+
+static void WriteLatencyMetric(std::ostream& out, const char* name, const char* help,
+	const LatencyHistogram& histogram)
+{
+	MetricFamily(out, name, "histogram", help);
+	out << "# UNIT " << name << " seconds\n";
+	WriteMetricHistogram(out, name, "", histogram);
+}
+
+// OpenMetrics text exposition. Reads the same atomics and meters as the
+// status line, so the mining threads never wait on a scrape.
+static void WriteMetrics(std::ostream& out)
+{
+	out.precision(10);
+
+	std::vector<std::shared_ptr<SolverStats>> solvers;
+	std::vector<std::string> solverLabels;
+	for (size_t i = 0; i < speed.GetSolverCount(); ++i)
+	{
+		std::shared_ptr<SolverStats> solver = speed.GetSolver(i);
+		if (!solver)
+			continue;
+		solvers.push_back(solver);
+		solverLabels.push_back("solver=\"" + std::to_string(i) + "\",name=" + MetricLabel(solver->name)
+			+ ",device=" + MetricLabel(solver->device));
+	}
+
+	MetricFamily(out, "aionminer_solver_hashes", "counter", "Equihash runs completed by the solver.");
+	for (size_t i = 0; i < solvers.size(); ++i)
+		out << "aionminer_solver_hashes_total{" << solverLabels[i] << "} " << solvers[i]->hash_count << "\n";
+	MetricFamily(out, "aionminer_solver_solutions", "counter", "Equihash solutions found by the solver.");
+	for (size_t i = 0; i < solvers.size(); ++i)
+		out << "aionminer_solver_solutions_total{" << solverLabels[i] << "} " << solvers[i]->solution_count << "\n";
+	MetricFamily(out, "aionminer_solver_hashrate", "gauge", "Runs per second of the solver over the reporting interval.");
+	for (size_t i = 0; i < solvers.size(); ++i)
+		out << "aionminer_solver_hashrate{" << solverLabels[i] << "} " << speed.GetSolverHashSpeed(*solvers[i]) << "\n";
+	MetricFamily(out, "aionminer_solver_solution_rate", "gauge", "Solutions per second of the solver over the reporting interval.");
+	for (size_t i = 0; i < solvers.size(); ++i)
+		out << "aionminer_solver_solution_rate{" << solverLabels[i] << "} " << speed.GetSolverSolutionSpeed(*solvers[i]) << "\n";
+	MetricFamily(out, "aionminer_solver_shares", "counter", "Solutions of the solver that met the share target.");
+	for (size_t i = 0; i < solvers.size(); ++i)
+		out << "aionminer_solver_shares_total{" << solverLabels[i] << "} " << solvers[i]->shares << "\n";
+	MetricFamily(out, "aionminer_solver_cancelled_runs", "counter", "Runs of the solver cancelled by a job switch.");
+	for (size_t i = 0; i < solvers.size(); ++i)
+		out << "aionminer_solver_cancelled_runs_total{" << solverLabels[i] << "} " << solvers[i]->wasted << "\n";
+	MetricFamily(out, "aionminer_solver_cancelled_seconds", "counter", "Time the solver spent in cancelled runs.");
+	out << "# UNIT aionminer_solver_cancelled_seconds seconds\n";
+	for (size_t i = 0; i < solvers.size(); ++i)
+		out << "aionminer_solver_cancelled_seconds_total{" << solverLabels[i] << "} " << solvers[i]->wasted_ms / 1000.0 << "\n";
+	MetricFamily(out, "aionminer_solver_paused", "gauge", "Whether the solver was paused through the API.");
+	for (size_t i = 0; i < solvers.size(); ++i)
+		out << "aionminer_solver_paused{" << solverLabels[i] << "} " << (solvers[i]->paused ? 1 : 0) << "\n";
+	MetricFamily(out, "aionminer_solver_memory_bytes", "gauge", "Memory a run of the solver allocates, for solvers that tell.");
+	out << "# UNIT aionminer_solver_memory_bytes bytes\n";
+	for (size_t i = 0; i < solvers.size(); ++i)
+		if (solvers[i]->memory)
+			out << "aionminer_solver_memory_bytes{" << solverLabels[i] << "} " << solvers[i]->memory << "\n";
+	MetricFamily(out, "aionminer_solver_solve_seconds", "histogram", "Duration of the solver's runs that were not cancelled.");
+	out << "# UNIT aionminer_solver_solve_seconds seconds\n";
+	for (size_t i = 0; i < solvers.size(); ++i)
+		WriteMetricHistogram(out, "aionminer_solver_solve_seconds", solverLabels[i], solvers[i]->solve_time);
+
+	MetricFamily(out, "aionminer_hashrate", "gauge", "Runs per second of all solvers over the reporting interval.");
+	out << "aionminer_hashrate " << speed.GetHashSpeed() << "\n";
+	MetricFamily(out, "aionminer_solution_rate", "gauge", "Solutions per second of all solvers over the reporting interval.");
+	out << "aionminer_solution_rate " << speed.GetSolutionSpeed() << "\n";
+	MetricFamily(out, "aionminer_shares_submitted", "counter", "Shares handed to the pool connections.");
+	out << "aionminer_shares_submitted_total " << speed.GetShareCount() << "\n";
+	MetricFamily(out, "aionminer_shares_accepted", "counter", "Shares the pools accepted.");
+	out << "aionminer_shares_accepted_total " << speed.GetShareOKCount() << "\n";
+	MetricFamily(out, "aionminer_shares_rejected", "counter", "Shares the pools rejected.");
+	out << "aionminer_shares_rejected_total " << speed.GetShareRejectedCount() << "\n";
+	MetricFamily(out, "aionminer_stale_shares", "counter", "Shares found after a clean job replaced theirs.");
+	out << "aionminer_stale_shares_total " << speed.GetStaleShares() << "\n";
+	MetricFamily(out, "aionminer_stale_shares_accepted", "counter", "Stale shares the pools accepted.");
+	out << "aionminer_stale_shares_accepted_total " << speed.GetStaleAccepted() << "\n";
+	MetricFamily(out, "aionminer_stale_shares_rejected", "counter", "Stale shares the pools rejected.");
+	out << "aionminer_stale_shares_rejected_total " << speed.GetStaleRejected() << "\n";
+	MetricFamily(out, "aionminer_filtered_solutions", "counter", "Solutions above the share target, not submitted.");
+	out << "aionminer_filtered_solutions_total " << speed.GetFilteredSolutions() << "\n";
+	MetricFamily(out, "aionminer_submit_queue", "gauge", "Shares waiting to be written to a pool.");
+	out << "aionminer_submit_queue " << speed.GetSubmitQueueDepth() << "\n";
+	MetricFamily(out, "aionminer_job_changes", "counter", "Clean jobs that replaced a job.");
+	out << "aionminer_job_changes_total " << speed.GetJobChanges() << "\n";
+	MetricFamily(out, "aionminer_job_change_wasted_seconds", "counter", "Solver time lost to runs cancelled by job changes.");
+	out << "# UNIT aionminer_job_change_wasted_seconds seconds\n";
+	out << "aionminer_job_change_wasted_seconds_total " << speed.GetWastedSeconds() << "\n";
+	MetricFamily(out, "aionminer_stale_runs", "counter", "Runs finished after their job was replaced.");
+	out << "aionminer_stale_runs_total " << speed.GetStaleRuns() << "\n";
+
+	WriteLatencyMetric(out, "aionminer_submit_latency_seconds", "Solution found to submit written.",
+		speed.GetSubmitLatencyHistogram());
+	WriteLatencyMetric(out, "aionminer_share_latency_seconds", "Submit written to pool response.",
+		speed.GetShareLatencyHistogram());
+	WriteLatencyMetric(out, "aionminer_job_latency_seconds", "Job received to first nonce started.",
+		speed.GetJobLatencyHistogram());
+	WriteLatencyMetric(out, "aionminer_pool_switch_seconds", "Active pool lost to standby mining.",
+		speed.GetPoolSwitchHistogram());
+
+	std::vector<std::shared_ptr<PoolStats>> pools;
+	std::vector<std::string> poolLabels;
+	for (size_t i = 0; i < speed.GetPoolCount(); ++i)
+	{
+		std::shared_ptr<PoolStats> pool = speed.GetPool(i);
+		if (!pool)
+			continue;
+		pools.push_back(pool);
+		poolLabels.push_back("pool=\"" + std::to_string(i) + "\",name=" + MetricLabel(pool->name)
+			+ ",source=\"" + std::to_string(pool->source) + "\"");
+	}
+
+	MetricFamily(out, "aionminer_pool_connected", "gauge", "Whether the miner is authorized on the pool.");
+	for (size_t i = 0; i < pools.size(); ++i)
+		out << "aionminer_pool_connected{" << poolLabels[i] << "} " << (pools[i]->connected ? 1 : 0) << "\n";
+	MetricFamily(out, "aionminer_pool_active", "gauge", "Whether the solvers mine the pool's jobs.");
+	for (size_t i = 0; i < pools.size(); ++i)
+		out << "aionminer_pool_active{" << poolLabels[i] << "} " << (pools[i]->active ? 1 : 0) << "\n";
+	MetricFamily(out, "aionminer_pool_active_seconds", "counter", "Time the solvers spent on the pool's jobs.");
+	out << "# UNIT aionminer_pool_active_seconds seconds\n";
+	for (size_t i = 0; i < pools.size(); ++i)
+		out << "aionminer_pool_active_seconds_total{" << poolLabels[i] << "} " << speed.GetPoolSeconds(*pools[i]) << "\n";
+	MetricFamily(out, "aionminer_pool_hashrate", "gauge", "Runs per second on the pool's jobs over the reporting interval.");
+	for (size_t i = 0; i < pools.size(); ++i)
+		out << "aionminer_pool_hashrate{" << poolLabels[i] << "} " << speed.GetPoolHashSpeed(*pools[i]) << "\n";
+	MetricFamily(out, "aionminer_pool_shares", "counter", "Shares found on the pool's jobs.");
+	for (size_t i = 0; i < pools.size(); ++i)
+		out << "aionminer_pool_shares_total{" << poolLabels[i] << "} " << pools[i]->shares << "\n";
+
+	out << "# EOF\n";
+}
 
-		double allshares = speed.GetShareSpeed() * 60;
-		double accepted = speed.GetShareOKSpeed() * 60;
 
-		ss << "{\"interval_seconds\":" << INTERVAL_SECONDS << ",";
-		ss << "\"speed_ips\":" << speed.GetHashSpeed() << ",";
-		ss << "\"speed_sps\":" << speed.GetSolutionSpeed() << ",";
-		ss << "\"accepted_per_minute\":" << accepted << ",";
-		ss << "\"rejected_per_minute\":" << (allshares - accepted);
-		ss << "},\"error\":null}";
+// Result of status, with the text histograms of the console for dump_stats
+static void WriteStatus(std::stringstream& ss, bool histograms)
+{
+	double allshares = speed.GetShareSpeed() * 60;
+	double accepted = speed.GetShareOKSpeed() * 60;
+
+	ss << "{\"interval_seconds\":" << INTERVAL_SECONDS << ",";
+	ss << "\"speed_ips\":" << speed.GetHashSpeed() << ",";
+	ss << "\"speed_sps\":" << speed.GetSolutionSpeed() << ",";
+	ss << "\"speed_ips_10s\":" << speed.GetHashSpeed(SPEED_WINDOW_SHORT) << ",";
+	ss << "\"speed_ips_60s\":" << speed.GetHashSpeed(SPEED_WINDOW_MEDIUM) << ",";
+	ss << "\"speed_ips_15m\":" << speed.GetHashSpeed(SPEED_WINDOW_LONG) << ",";
+	ss << "\"speed_sps_10s\":" << speed.GetSolutionSpeed(SPEED_WINDOW_SHORT) << ",";
+	ss << "\"speed_sps_60s\":" << speed.GetSolutionSpeed(SPEED_WINDOW_MEDIUM) << ",";
+	ss << "\"speed_sps_15m\":" << speed.GetSolutionSpeed(SPEED_WINDOW_LONG) << ",";
+	ss << "\"accepted_per_minute\":" << accepted << ",";
+	ss << "\"rejected_per_minute\":" << (allshares - accepted) << ",";
+	ss << "\"first_hash_ms\":" << speed.GetFirstHashLatency() << ",";
+	ss << "\"submit_queue\":" << speed.GetSubmitQueueDepth() << ",";
+	ss << "\"submit_latency_ms\":" << speed.GetSubmitLatency() << ",";
+	ss << "\"submit_latency_max_ms\":" << speed.GetSubmitLatencyMax() << ",";
+	ss << "\"stale_shares\":" << speed.GetStaleShares() << ",";
+	ss << "\"stale_accepted\":" << speed.GetStaleAccepted() << ",";
+	ss << "\"stale_rejected\":" << speed.GetStaleRejected() << ",";
+	ss << "\"stale_runs_finished\":" << speed.GetStaleRuns() << ",";
+	ss << "\"filtered_solutions\":" << speed.GetFilteredSolutions() << ",";
+	ss << "\"job_changes\":" << speed.GetJobChanges() << ",";
+	ss << "\"wasted_seconds_per_job_change\":" << speed.GetWastedPerJobChange() << ",";
+	ss << "\"submit_latency_hist\":";
+	WriteHistogram(ss, speed.GetSubmitLatencyHistogram());
+	ss << ",\"share_latency_hist\":";
+	WriteHistogram(ss, speed.GetShareLatencyHistogram());
+	ss << ",\"job_latency_hist\":";
+	WriteHistogram(ss, speed.GetJobLatencyHistogram());
+	ss << ",\"pool_switch_hist\":";
+	WriteHistogram(ss, speed.GetPoolSwitchHistogram());
+	ss << ",\"pools\":";
+	WritePools(ss);
+	ss << ",\"solvers\":";
+	WriteSolvers(ss);
+	if (histograms)
+	{
+		std::stringstream text;
+		speed.PrintHistograms(text);
+		ss << ",\"histograms\":" << JsonString(text.str());
+	}
+	ss << "}";
+}
+
+
+void Client::Parse(const std::string& request)
+{
+	StratumMessage message;
+	std::string method;
+	if (ParseStratumMessage(request.data(), request.size(), message))
+	{
+		if (message.methodName.is(StratumToken::Type::String))
+			method = message.methodName.str();
 	}
 	else
 	{
+		message.clear();
+		// A bare method name, as "status"
+		if (request.find_first_of(" \t\"{}[]") == std::string::npos)
+			method = request;
+	}
+
+	// Other threads answer through the API thread, which owns the socket
+	int id = message.id;
+	std::shared_ptr<Client> self = shared_from_this();
+	std::shared_ptr<boost::asio::io_service> io_service = m_api.getIOService();
+	m_pending++;
+	API::Reply reply = [self, io_service, id, method](const std::string& result, const std::string& error)
+	{
+		std::stringstream ss;
+		ss << "{\"id\":";
+		if (id)
+			ss << id;
+		else
+			ss << "null";
+		ss << ",\"method\":" << JsonString(method) << ",\"result\":";
+		if (error.empty())
+			ss << result << ",\"error\":null}";
+		else
+			ss << "false,\"error\":" << JsonString(error) << "}";
+		ss << "\n";
+		std::string out = ss.str();
+		io_service->post([self, out]()
+		{
+			self->m_pending--;
+			self->Send(out);
+		});
+	};
+
+	try
+	{
+		if (!method.empty() && m_api.call(method, message.params, reply))
+			return;
 		BOOST_LOG_CUSTOM(debug) << "Invalid request: " << request;
+		reply("", "Invalid request.");
+	}
+	catch (std::exception& ex)
+	{
+		BOOST_LOG_CUSTOM(error) << method << ": " << ex.what();
+		reply("", ex.what());
+	}
+}
+
 
-		ss << "false,\"error\":\"Invalid request.\"}";
+void Client::ServeHttp()
+{
+	BOOST_LOG_CUSTOM(debug) << "Responding to GET " << m_path;
+
+	std::stringstream body;
+	const char* status = "200 OK";
+	const char* type = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+	if (m_path.substr(0, m_path.find('?')) == "/metrics")
+		WriteMetrics(body);
+	else
+	{
+		status = "404 Not Found";
+		type = "text/plain; charset=utf-8";
+		body << "Metrics are at /metrics\n";
 	}
+	std::string content = body.str();
 
-	ss << "\n";
-	std::string out = ss.str();
+	std::stringstream ss;
+	ss << "HTTP/1.1 " << status << "\r\n";
+	ss << "Content-Type: " << type << "\r\n";
+	ss << "Content-Length: " << content.size() << "\r\n";
+	ss << "Connection: close\r\n\r\n";
+	m_closing = true;
+	Send(ss.str() + content);
+}
 
+
+void Client::Send(const std::string& out)
+{
 	BOOST_LOG_CUSTOM(trace) << "Sending: " << out;
 
-	std::vector<boost::asio::const_buffer> buffers;
-	buffers.push_back(boost::asio::buffer(out));
+	m_write_queue.push_back(out);
+	if (m_write_queue.size() > 1)
+		return;
+	boost::asio::async_write(m_socket, boost::asio::buffer(m_write_queue.front()),
+		boost::bind(&Client::Written, shared_from_this(),
+		boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+}
 
-	boost::system::error_code ec;
-	m_socket.send(buffers, 0, ec);
+
+void Client::Written(const boost::system::error_code& ec, std::size_t bytes_transferred)
+{
 	if (ec)
 	{
 		BOOST_LOG_CUSTOM(debug) << ec;
-		return false;
+		m_write_queue.clear();
+		Close();
+		return;
 	}
+	m_write_queue.pop_front();
+	if (!m_write_queue.empty())
+		boost::asio::async_write(m_socket, boost::asio::buffer(m_write_queue.front()),
+			boost::bind(&Client::Written, shared_from_this(),
+			boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+	else if (m_closing && !m_pending)
+		Close();
+}
 
-	return true;
+
+void Client::Close()
+{
+	boost::system::error_code ignored;
+	m_socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+	m_socket.close(ignored);
 }
@@ -1,33 +1,85 @@
 #pragma once
 
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <boost/asio.hpp>
+
+#include "libstratum/StratumMessage.h"
+
+// Longest request line, past it the connection is dropped
+#define API_MAX_LINE 4096
+
+/**
+ * Answers JSON lines {"id":..,"method":..,"params":[..]} on its own I/O
+ * thread, so neither slow readers nor commands waiting on a pool hold up
+ * mining or each other. Replies carry the request's id and may come out of
+ * order, a connection may send its next request before the last is
+ * answered. A bare method name on a line is taken as a request without
+ * params, an HTTP GET of /metrics as a scrape.
+ */
 class API
 {
+public:
+	// Hands back the result as JSON text, or a non-empty error, from any thread
+	typedef std::function<void(const std::string& result, const std::string& error)> Reply;
+	// Runs on the API thread and must not block. params point into the
+	// request line, which is gone once the command returns.
+	typedef std::function<void(const StratumField& params, const Reply& reply)> Command;
+
+	API();
+	virtual ~API();
+
+	// Before start, status and dump_stats are built in
+	void addCommand(const std::string& method, const Command& command);
+	bool start(int local_port, const std::string& address = "127.0.0.1");
+
+	// From the API thread, false if there is no such command
+	bool call(const std::string& method, const StratumField& params, const Reply& reply) const;
+	// Replies from other threads are posted to it, it outlives the API
+	// while one is on its way
+	std::shared_ptr<boost::asio::io_service> getIOService() const { return m_io_service; }
+
+private:
 	std::shared_ptr<boost::asio::io_service> m_io_service;
+	std::unique_ptr<boost::asio::io_service::work> m_work;
 	boost::asio::ip::tcp::acceptor m_acceptor;
 	boost::asio::ip::tcp::socket m_socket;
+	std::map<std::string, Command> m_commands;
+	std::thread m_thread;
 
 	void do_accept();
-
-public:
-	API(std::shared_ptr<boost::asio::io_service> io_service);
-	virtual ~API();
-
-	bool start(int local_port);
-	bool poll();
 };
 
 
+// One API connection, its handlers run on the API thread
 class Client : public std::enable_shared_from_this<Client>
 {
+	const API& m_api;
 	boost::asio::ip::tcp::socket m_socket;
 	boost::asio::streambuf m_response_buffer;
+	std::string m_path; // of the HTTP request
+	// Front is being written, the connection closes once it drains if m_closing
+	std::deque<std::string> m_write_queue;
+	bool m_closing;
+	int m_pending; // requests whose reply is not queued yet
 
+	void Read();
 	void ReadResponse(const boost::system::error_code& ec, std::size_t bytes_transferred);
-	bool Parse(const std::string& request);
+	void Parse(const std::string& request);
+	// Skips request headers up to the empty line, then answers
+	void ReadHeader(const boost::system::error_code& ec, std::size_t bytes_transferred);
+	void ServeHttp();
+	void Send(const std::string& out);
+	void Written(const boost::system::error_code& ec, std::size_t bytes_transferred);
+	void Close();
 
 public:
-	Client(boost::asio::ip::tcp::socket socket);
+	Client(const API& api, boost::asio::ip::tcp::socket socket);
 	virtual ~Client();
 
 	void Start();
-};
\ No newline at end of file
+};
@@ -10,80 +10,97 @@
 #include "streams.h"
 #include <byteswap.h>
 
+#include <algorithm>
 #include <iostream>
 #include <atomic>
 #include <thread>
 #include <chrono>
+#include <condition_variable>
 #include <boost/thread/exceptions.hpp>
+#include <boost/bind.hpp>
 #include <boost/log/trivial.hpp>
 #include <boost/circular_buffer.hpp>
 #include "speed.hpp"
 #include <cstdint>
 #include "../../blake2/blake2.h"
+#include "../../equiverify/equiverify.h"
 #include <boost/static_assert.hpp>
 
-typedef uint32_t eh_index;
 
 #define BOOST_LOG_CUSTOM(sev, pos) BOOST_LOG_TRIVIAL(sev) << "miner#" << pos << " | "
 
-void CompressArray(const unsigned char* in, size_t in_len, unsigned char* out,
-		size_t out_len, size_t bit_len, size_t byte_pad) {
-	assert(bit_len >= 8);
-	assert(8 * sizeof(uint32_t) >= 7 + bit_len);
-
-	size_t in_width { (bit_len + 7) / 8 + byte_pad };
-	assert(out_len == bit_len * in_len / (8 * in_width));
-
-	uint32_t bit_len_mask { ((uint32_t) 1 << bit_len) - 1 };
-
-	// The acc_bits least-significant bits of acc_value represent a bit sequence
-	// in big-endian order.
-	size_t acc_bits = 0;
-	uint32_t acc_value = 0;
-
-	size_t j = 0;
-	for (size_t i = 0; i < out_len; i++) {
-		// When we have fewer than 8 bits left in the accumulator, read the next
-		// input element.
-		if (acc_bits < 8) {
-			acc_value = acc_value << bit_len;
-			for (size_t x = byte_pad; x < in_width; x++) {
-				acc_value = acc_value
-						| ((
-						// Apply bit_len_mask across byte boundaries
-						in[j + x]
-								& ((bit_len_mask >> (8 * (in_width - x - 1)))
-										& 0xFF)) << (8 * (in_width - x - 1))); // Big-endian
-			}
-			j += in_width;
-			acc_bits += bit_len;
+void CompressIndices(const uint32_t* indices, size_t count, size_t bitLen,
+		unsigned char* out) {
+	assert(bitLen >= 8 && bitLen <= 32);
+	assert((count * bitLen) % 8 == 0);
+
+	// The accBits least-significant bits of acc are pending output, flushed
+	// a 32-bit word at a time. At most 31 + bitLen bits are ever pending.
+	const uint64_t mask = ((uint64_t) 1 << bitLen) - 1;
+	uint64_t acc = 0;
+	size_t accBits = 0;
+	for (size_t i = 0; i < count; i++) {
+		acc = (acc << bitLen) | (indices[i] & mask);
+		accBits += bitLen;
+		if (accBits >= 32) {
+			accBits -= 32;
+			uint32_t word = htobe32((uint32_t) (acc >> accBits));
+			memcpy(out, &word, sizeof(word));
+			out += sizeof(word);
 		}
-
-		acc_bits -= 8;
-		out[i] = (acc_value >> acc_bits) & 0xFF;
+	}
+	while (accBits >= 8) {
+		accBits -= 8;
+		*out++ = (acc >> accBits) & 0xFF;
 	}
 }
 
-void EhIndexToArray(const eh_index i, unsigned char* array) {
-	BOOST_STATIC_ASSERT(sizeof(eh_index) == 4);
-	eh_index bei = htobe32(i);
-	memcpy(array, &bei, sizeof(eh_index));
+static const char hexDigits[] = "0123456789abcdef";
+
+static void AppendHex(std::string& out, const unsigned char* data, size_t len) {
+	for (size_t i = 0; i < len; i++) {
+		out += hexDigits[data[i] >> 4];
+		out += hexDigits[data[i] & 0xF];
+	}
 }
 
-std::vector<unsigned char> GetMinimalFromIndices(std::vector<eh_index> indices,
-		size_t cBitLen) {
-	assert(((cBitLen + 1) + 7) / 8 <= sizeof(eh_index));
-	size_t lenIndices { indices.size() * sizeof(eh_index) };
-	size_t minLen { (cBitLen + 1) * lenIndices / (8 * sizeof(eh_index)) };
-	size_t bytePad { sizeof(eh_index) - ((cBitLen + 1) + 7) / 8 };
-	std::vector<unsigned char> array(lenIndices);
-	for (int i = 0; i < indices.size(); i++) {
-		EhIndexToArray(indices[i], array.data() + (i * sizeof(eh_index)));
+void EquihashSolution::appendNonce2Hex(std::string& out) const {
+	// The pool knows nonce1, only the rest of the hex nonce is sent
+	char hex[64];
+	for (size_t i = 0; i < 32; i++) {
+		hex[2 * i] = hexDigits[nonce.begin()[i] >> 4];
+		hex[2 * i + 1] = hexDigits[nonce.begin()[i] & 0xF];
 	}
-	std::vector<unsigned char> ret(minLen);
-	CompressArray(array.data(), lenIndices, ret.data(), minLen, cBitLen + 1,
-			bytePad);
-	return ret;
+	out.append(hex + nonce1size, sizeof(hex) - nonce1size);
+}
+
+void EquihashSolution::appendSolutionHex(std::string& out) const {
+	// Compact size prefix, as the solution is serialized as a vector
+	BOOST_STATIC_ASSERT(sizeof(solution) >= 253 && sizeof(solution) <= 0xFFFF);
+	const unsigned char size[3] = { 0xFD, sizeof(solution) & 0xFF, sizeof(solution) >> 8 };
+	AppendHex(out, size, sizeof(size));
+	AppendHex(out, solution, sizeof(solution));
+}
+
+SolutionPool::SolutionPool(size_t capacity) :
+		m_records(capacity) {
+	m_free.reserve(capacity);
+	for (EquihashSolution& record : m_records)
+		m_free.push_back(&record);
+}
+
+EquihashSolution* SolutionPool::acquire() {
+	std::lock_guard<std::mutex> lock { m_mutex };
+	if (m_free.empty())
+		return nullptr;
+	EquihashSolution* solution = m_free.back();
+	m_free.pop_back();
+	return solution;
+}
+
+void SolutionPool::release(EquihashSolution* solution) {
+	std::lock_guard<std::mutex> lock { m_mutex };
+	m_free.push_back(solution);
 }
 
 void static AionMinerThread(AionMiner* miner, int size, int pos,
@@ -91,311 +108,131 @@ void static AionMinerThread(AionMiner* miner, int size, int pos,
 	BOOST_LOG_CUSTOM(info, pos) << "Starting thread #" << pos << " ("
 			<< solver->getname() << ") " << solver->getdevinfo();
 
-	std::shared_ptr < std::mutex > m_zmt(new std::mutex);
-	ABlockHeader header;
-	arith_uint256 space;
-	size_t offset;
-	arith_uint256 inc;
-	arith_uint256 target;
-	std::string target_str;
-	std::string jobId;
-	std::string nTime;
-	std::atomic_bool workReady { false };
-	std::atomic_bool cancelSolver { false };
-	std::atomic_bool pauseMining { false };
-
-	miner->NewJob.connect(
-			NewJob_t::slot_type(
-					[&m_zmt, &header, &space, &offset, &inc, &target, &workReady, &cancelSolver, pos, &pauseMining, &jobId, &nTime]
-					(const AionJob* job) mutable {
-						std::lock_guard<std::mutex> lock {*m_zmt.get()};
-						if (job) {
-							BOOST_LOG_CUSTOM(debug, pos) << "Loading new job #" << job->jobId();
-							jobId = job->jobId();
-							nTime = job->time;
-							header = job->header;
-							space = job->nonce2Space;
-							offset = job->nonce1Size * 4; // Hex length to bit length
-							inc = job->nonce2Inc;
-							target = job->serverTarget;
-							pauseMining.store(false);
-							workReady.store(true);
-							if (job->clean) {
-								cancelSolver.store(true);
-							}
-
-						} else {
-							workReady.store(false);
-							cancelSolver.store(true);
-							pauseMining.store(true);
-						}
-					}).track_foreign(m_zmt)); // So the signal disconnects when the mining thread exits
-
-	try {
-
-		solver->start();
+	// Source and epoch of the job this thread is working on
+	size_t source = 0;
+	uint64_t epoch = 0;
+	std::shared_ptr<const AionJob> job;
+	uint256 bNonce;
 
-		while (true) {
-			// Wait for work
-			bool expected;
-			do {
-				expected = true;
-				if (!miner->minerThreadActive[pos])
-					throw boost::thread_interrupted();
-				//boost::this_thread::interruption_point();
-				std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-			} while (!workReady.compare_exchange_weak(expected, false));
-			// TODO change atomically with workReady
-			cancelSolver.store(false);
-
-			// Calculate nonce limits
-			arith_uint256 nonce;
-			arith_uint256 nonceEnd;
-			ABlockHeader actualHeader;
-			std::string actualJobId;
-			std::string actualTime;
-			arith_uint256 actualTarget;
-			size_t actualNonce1size;
+	// The callbacks only reference the loop state, so they are built once
+	std::function<
+			void(const uint32_t*, size_t,
+					const unsigned char*)> solutionFound =
+			[&job, &source, &epoch, &bNonce, miner, pos]
+			(const uint32_t* indices, size_t cbitlen, const unsigned char* compressed_sol)
 			{
-				std::lock_guard < std::mutex > lock { *m_zmt.get() };
-				arith_uint256 baseNonce = UintToArith256(header.nNonce);
-				arith_uint256 add(pos);
-				nonce = baseNonce | (add << (8 * 19));
-				nonceEnd = baseNonce | ((add + 1) << (8 * 19));
-				//nonce = baseNonce + ((space/size)*pos << offset);
-				//nonceEnd = baseNonce + ((space/size)*(pos+1) << offset);
-
-				// save job id and time
-				actualHeader = header;
-				actualJobId = jobId;
-				actualTime = nTime;
-				actualNonce1size = offset / 4;
-				actualTarget = target;
-			}
-
-			// Start working
-			while (true) {
-
-				// every iteration need a new timestamp on header.
-				CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-				{
-
-					// //  get timestamp in seconds.
-					// uint64_t lets =
-					// 		std::chrono::duration_cast
-					// 				< std::chrono::milliseconds
-					// 				> (std::chrono::system_clock::now().time_since_epoch()).count();
-					// lets /= 1000;
-
-					// // convert to BE
-					// uint64_t bets = __bswap_64(lets);
-
-					// // update the header.
-					// actualHeader.timeStamp = bets;
-
-					// steam out for hash iteration.
-					AEquihashInput I { actualHeader };
-					ss << I;
-
-					// printf("Equihash Input Fields: \n");
-					// BOOST_LOG_CUSTOM(debug, pos) << "Parent Hash:  " << actualHeader.parentHash.ToString();
-					// BOOST_LOG_CUSTOM(debug, pos) << "CoinBase:  " << actualHeader.coinBase.ToString();
-					// BOOST_LOG_CUSTOM(debug, pos) << "State root:  " << actualHeader.stateRoot.ToString();
-					// BOOST_LOG_CUSTOM(debug, pos) << "txTrie:  " << actualHeader.txTrie.ToString();
-					// BOOST_LOG_CUSTOM(debug, pos) << "ReceiptTreeRoot :  " << actualHeader.receiptTreeRoot.ToString();
-					// BOOST_LOG_CUSTOM(debug, pos) << "LogsBloom:  " << actualHeader.logsBloom.ToString();
-					// BOOST_LOG_CUSTOM(debug, pos) << "Difficulty:  " << actualHeader.difficulty.ToString();
-					// BOOST_LOG_CUSTOM(debug, pos) << "Timestamp:  " << actualHeader.timeStamp;
-					// BOOST_LOG_CUSTOM(debug, pos) << "NUmber:  " << actualHeader.number;
-					// BOOST_LOG_CUSTOM(debug, pos) << "extraData:  " << actualHeader.extraData.ToString();
-					// BOOST_LOG_CUSTOM(debug, pos) << "energyConsumed:  " << actualHeader.energyConsumed;
-					// BOOST_LOG_CUSTOM(debug, pos) << "energyLimit:  " << actualHeader.energyLimit;
+				speed.AddSolution(pos);
 
+				EquihashSolution* solution = miner->acquireSolution();
+				if (!solution) {
+					BOOST_LOG_CUSTOM(warning, pos) << "Solution pool exhausted, dropping solution";
+					return;
+				}
+				solution->nonce = bNonce;
+				solution->nonce1size = job->nonce1Size;
+				if (compressed_sol)
+					memcpy(solution->solution, compressed_sol, sizeof(solution->solution));
+				else
+					CompressIndices(indices, 1 << EQUIVERIFY_K, cbitlen + 1, solution->solution);
+
+				BOOST_LOG_CUSTOM(debug, pos) << "Checking solution against target...";
+
+				//Generate 32 byte hash of the header (with solution and nonce)
+				blake2b_state state = job->shareState;
+				blake2b_update(&state, bNonce.begin(), bNonce.size());
+				blake2b_update(&state, solution->solution, sizeof(solution->solution));
+				unsigned char hash[32];
+				blake2b_final(&state, hash, 32);
+
+				if (!miner->meetsTarget(source, *job, hash)) {
+					//Hash of the header was greater than the share target
+					BOOST_LOG_CUSTOM(debug, pos) << "Hash of header was larger than target";
+					speed.AddFilteredSolution();
+					miner->releaseSolution(solution);
+					return;
 				}
 
-				char *tequihash_header = (char *) &ss[0];
-				unsigned int tequihash_header_len = ss.size();
-
-				BOOST_LOG_CUSTOM(debug, pos)
-						<< "Running Equihash solver with nNonce = "
-						<< nonce.ToString();
-
-				auto bNonce = ArithToUint256(nonce);
-
-				std::function<
-						void(const std::vector<uint32_t>&, size_t,
-								const unsigned char*)> solutionFound =
-						[&actualHeader, &bNonce, &actualTarget, &miner, pos, &actualJobId, &actualTime, &actualNonce1size]
-						(const std::vector<uint32_t>& index_vector, size_t cbitlen, const unsigned char* compressed_sol)
-						{
-							actualHeader.nNonce = bNonce;
-							if (compressed_sol)
-							{
-								//Change vector to 1408 to accomodate new 210,9 parameters
-								actualHeader.nSolution = std::vector<unsigned char>(1408);
-								for (size_t i = 0; i < cbitlen; ++i)
-								actualHeader.nSolution[i] = compressed_sol[i];
-							}
-							else
-							actualHeader.nSolution = GetMinimalFromIndices(index_vector, cbitlen);
-
-							speed.AddSolution();
-
-							BOOST_LOG_CUSTOM(debug, pos) << "Checking solution against target...";
-							BOOST_LOG_CUSTOM(debug, pos) << "Compressed solution size: " << actualHeader.nSolution.size();
-
-							//Create a new vector with size equaling a full header
-							std::vector<uint8_t> headerBytes;
-							//Reserve header + nonce + solution size
-							headerBytes.reserve(actualHeader.HEADER_SIZE + 32 + 1408);
-
-							// headerBytes.insert(headerBytes.end(), actualHeader.parentHash.begin(), actualHeader.parentHash.end());
-							// headerBytes.insert(headerBytes.end(), actualHeader.coinBase.begin(), actualHeader.coinBase.end());
-							// headerBytes.insert(headerBytes.end(), actualHeader.stateRoot.begin(), actualHeader.stateRoot.end());
-							// headerBytes.insert(headerBytes.end(), actualHeader.txTrie.begin(), actualHeader.txTrie.end());
-							// headerBytes.insert(headerBytes.end(), actualHeader.receiptTreeRoot.begin(), actualHeader.receiptTreeRoot.end());
-							// headerBytes.insert(headerBytes.end(), actualHeader.logsBloom.begin(), actualHeader.logsBloom.end());
-							// headerBytes.insert(headerBytes.end(), actualHeader.difficulty.begin(), actualHeader.difficulty.end());
-							// uint8_t * timestamp = (uint8_t*)&actualHeader.timeStamp;
-							// for(int i = 0; i < 8; i++) {
-							// 	headerBytes.push_back(*(timestamp+i));
-							// }
-
-							// uint8_t * number = (uint8_t*)&actualHeader.number;
-							// for(int i = 0; i < 8; i++) {
-							// 	headerBytes.push_back(*(number+i));
-							// }
-
-							// headerBytes.insert(headerBytes.end(), actualHeader.extraData.begin(), actualHeader.extraData.end());
-							// headerBytes.insert(headerBytes.end(), actualHeader.nNonce.begin(), actualHeader.nNonce.end());
-							// headerBytes.insert(headerBytes.end(), actualHeader.nSolution.begin(), actualHeader.nSolution.end());
-
-							// uint8_t * energyConsumed = (uint8_t*)&actualHeader.energyConsumed;
-							// for(int i = 0; i < 8; i++) {
-							// 	headerBytes.push_back(*(energyConsumed + i));
-							// }
-
-							// uint8_t * energyLimit = (uint8_t*)&actualHeader.energyLimit;
-							// for(int i = 0; i < 8; i++) {
-							// 	headerBytes.push_back(*(energyLimit+i));
-							// }
-
-							headerBytes.insert(headerBytes.end(), actualHeader.headerHash.begin(), actualHeader.headerHash.end());
-
-							// uint8_t * timestamp = (uint8_t*)&actualHeader.timeStamp;
-							// for(int i = 0; i < 8; i++) {
-							// 	headerBytes.push_back(*(timestamp+i));
-							// }
-							headerBytes.insert(headerBytes.end(), actualHeader.nNonce.begin(), actualHeader.nNonce.end());
-							headerBytes.insert(headerBytes.end(), actualHeader.nSolution.begin(), actualHeader.nSolution.end());
-
-
-							BOOST_LOG_CUSTOM(debug, pos) << "headerBytes size: " << headerBytes.size();
-
-							unsigned char * headerInput = &headerBytes[0];
-							blake2b_state target_state;
-
-							blake2b_param P[1];
-							P->digest_length = 32;
-							P->key_length = 0;
-							P->fanout = 1;
-							P->depth = 1;
-							P->leaf_length = 0;
-							P->node_offset = 0;
-							P->node_depth = 0;
-							P->inner_length = 0;
-							memset(P->reserved, 0, sizeof(P->reserved));
-							memset(P->salt, 0, sizeof(P->salt));
-							memset(P->personal, 0, sizeof(P->personal));
-							blake2b_init_param(&target_state, P);
-
-							blake2b_update(&target_state, headerInput, headerBytes.size());
-
-							//Generate 32 byte hash of the header (with solution and nonce)
-							unsigned char hash[32];
-							blake2b_final(&target_state, hash, 32);
-
-							std::string targetHex = actualTarget.GetHex();
-
-							std::vector<unsigned char> bytes;
-							bytes.reserve(targetHex.size() / 2);
-							for (std::string::size_type i = 0, i_end = targetHex.size(); i < i_end; i += 2)
-							{
-								unsigned byte;
-								std::istringstream hex_byte(targetHex.substr(i, 2));
-								hex_byte >> std::hex >> byte;
-								bytes.push_back(static_cast<unsigned char>(byte));
-							}
-
-							unsigned char * targetBytes = &bytes[0];
-
-							int targetComp = memcmp(hash, targetBytes, 32);
-
-							std::vector<uint8_t> h;
-							h.assign(hash, hash+32);
-							uint256 hdrHash = base_blob<256>(h);
-
-							if(targetComp >= 0) {
-								//Hash of the header was greater than TargetBytes
-								BOOST_LOG_CUSTOM(debug, pos) << "Hash of header was larger than target";
-								return;
-							}
-
-							// Found a solution
-							BOOST_LOG_CUSTOM(debug, pos) << "Found a valid solution";
-
-							EquihashSolution solution {actualHeader.nNonce, actualHeader.nSolution, actualTime, actualNonce1size};
-
-
-							//  get timestamp in seconds.
-							uint64_t lets =
-									std::chrono::duration_cast
-											< std::chrono::milliseconds
-											> (std::chrono::system_clock::now().time_since_epoch()).count();
-							lets /= 1000;
-
-							// convert to BE
-							uint64_t bets = __bswap_64(lets);
-
-							// submit with timestamp of submission
-							miner->submitSolution(solution, actualJobId, bets);
-						};
-
-				std::function < bool() > cancelFun = [&cancelSolver]() {
-					return cancelSolver.load();
-				};
-
-				std::function<void(void)> hashDone = []() {
-					speed.AddHash();
-				};
-
-				// Check for stop
-				if (!miner->minerThreadActive[pos])
-					throw boost::thread_interrupted();
+				// Found a solution
+				BOOST_LOG_CUSTOM(debug, pos) << "Found a valid solution";
+				speed.AddSolverShare(pos);
+				speed.AddPoolShare(job->connection);
+				// Jobs that are not clean leave earlier ones valid
+				solution->stale = miner->isCancelled(source, epoch);
+				if (solution->stale)
+					speed.AddStaleShare();
+
+				//  get timestamp in seconds.
+				uint64_t lets =
+						std::chrono::duration_cast
+								< std::chrono::milliseconds
+								> (std::chrono::system_clock::now().time_since_epoch()).count();
+				lets /= 1000;
+
+				// convert to BE
+				uint64_t bets = __bswap_64(lets);
+
+				// submit with timestamp of submission
+				miner->submitSolution(solution, *job, bets);
+			};
 
-				solver->solve(tequihash_header, tequihash_header_len,
-						(const char*) bNonce.begin(), bNonce.size(), cancelFun,
-						solutionFound, hashDone);
+	// Cancellation checkpoints passed in this run and in the last full run,
+	// the solver's progress through a run
+	unsigned int checkpoints = 0;
+	unsigned int runCheckpoints = 0;
+	bool aborted = false;
 
-				//boost::this_thread::interruption_point();
+	std::function < bool() > cancelFun = [miner, pos, &source, &epoch,
+			&checkpoints, &runCheckpoints, &aborted]() {
+		aborted = miner->shouldAbort(pos, source, epoch, ++checkpoints,
+				runCheckpoints);
+		return aborted;
+	};
 
-				// Update nonce
-				nonce += inc;
+	std::function<void(void)> hashDone = [pos, &job]() {
+		speed.AddHash(pos);
+		speed.AddPoolHash(job->connection);
+	};
 
-				if (nonce == nonceEnd) {
-					break;
-				}
+	try {
 
-				// Check for new work
-				if (workReady.load()) {
-					BOOST_LOG_CUSTOM(debug, pos)
-							<< "New work received, dropping current work";
-					break;
-				}
+		solver->start();
 
-				if (pauseMining.load()) {
-					BOOST_LOG_CUSTOM(debug, pos) << "Mining paused";
-					break;
+		uint64_t counter;
+		// Wait for work, one nonce of whichever source's turn it is
+		while (miner->nextWork(pos, source, epoch, job, counter)) {
+			// Nonce2 counters come from the scheduler and sit above nonce1
+			arith_uint256 baseNonce = UintToArith256(job->header.nNonce);
+			unsigned int nonce1Bits = job->nonce1Size * 4; // Hex length to bit length
+			arith_uint256 nonce = baseNonce | (arith_uint256(counter) << nonce1Bits);
+
+			BOOST_LOG_CUSTOM(debug, pos)
+					<< "Running Equihash solver with nNonce = "
+					<< nonce.ToString();
+
+			bNonce = ArithToUint256(nonce);
+
+			auto solveStart = std::chrono::steady_clock::now();
+			checkpoints = 0;
+			aborted = false;
+			solver->solve((const char*) job->input, sizeof(job->input),
+					(const char*) bNonce.begin(), bNonce.size(), cancelFun,
+					solutionFound, hashDone);
+
+			//boost::this_thread::interruption_point();
+
+			// Aborted runs would understate the time a nonce takes
+			double solveTime = std::chrono::duration<double>(
+					std::chrono::steady_clock::now() - solveStart).count();
+			// Runs dropped by a pause are not lost to a job switch
+			if (!aborted || !miner->isPaused(pos))
+				speed.AddSolveTime(pos, solveTime, aborted);
+			speed.SetSolverMemory(pos, solver->getmemory());
+			if (!aborted) {
+				runCheckpoints = checkpoints;
+				miner->recordSolveTime(pos, solveTime);
+				if (miner->isCancelled(source, epoch)) {
+					BOOST_LOG_CUSTOM(debug, pos) << "Finished run of replaced job";
+					speed.AddStaleRun();
 				}
 			}
 		}
@@ -427,6 +264,11 @@ AionJob* AionJob::clone() const {
 	ret->serverTarget = serverTarget;
 	ret->serverTarget_str = serverTarget_str;
 	ret->clean = clean;
+	ret->source = source;
+	ret->connection = connection;
+	memcpy(ret->input, input, sizeof(input));
+	ret->shareState = shareState;
+	memcpy(ret->targetBytes, targetBytes, sizeof(targetBytes));
 	return ret;
 }
 
@@ -444,6 +286,38 @@ void AionJob::setTarget(std::string target) {
 	}
 }
 
+void AionJob::setTarget(const char* hex, size_t size) {
+	if (size > 0) {
+		serverTarget_str.assign(hex, size);
+		uint256 target;
+		target.SetHex(serverTarget_str);
+		serverTarget = UintToArith256(target);
+	} else {
+		serverTarget_str.clear();
+		setTarget(std::string());
+	}
+}
+
+void AionJob::prepare() {
+	// AEquihashInput serializes the header hash alone, as its raw bytes
+	BOOST_STATIC_ASSERT(sizeof(input) == sizeof(header.headerHash));
+	memcpy(input, header.headerHash.begin(), sizeof(input));
+
+	// The share hash is an unkeyed BLAKE2b-256 of input, nonce and solution
+	blake2b_param P[1];
+	memset(P, 0, sizeof(P));
+	P->digest_length = 32;
+	P->fanout = 1;
+	P->depth = 1;
+	blake2b_init_param(&shareState, P);
+	blake2b_update(&shareState, input, sizeof(input));
+
+	// uint256 stores the least significant byte first
+	uint256 target = ArithToUint256(serverTarget);
+	for (size_t i = 0; i < sizeof(targetBytes); i++)
+		targetBytes[i] = target.begin()[sizeof(targetBytes) - 1 - i];
+}
+
 void AionJob::diffToTarget(uint32_t *target, double diff) {
 	
 	uint32_t target2[8];
@@ -466,25 +340,49 @@ void AionJob::diffToTarget(uint32_t *target, double diff) {
 }
 
 std::string AionJob::getSubmission(const EquihashSolution* solution) {
-	CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-	ss << solution->nonce;
-	ss << solution->solution;
-	std::string strHex = HexStr(ss.begin(), ss.end());
-
-	std::stringstream stream;
-	stream << "\"" << job;
-	stream << "\",\"" << time;
-	stream << "\",\"" << strHex.substr(nonce1Size, 64 - nonce1Size);
-	stream << "\",\"" << strHex.substr(64);
-	stream << "\"";
-	return stream.str();
-}
-
-AionMiner::AionMiner(const std::vector<ISolver *> &i_solvers) :
-		minerThreads { nullptr } {
+	std::string ret = "\"" + job + "\",\"" + time + "\",\"";
+	solution->appendNonce2Hex(ret);
+	ret += "\",\"";
+	solution->appendSolutionHex(ret);
+	ret += "\"";
+	return ret;
+}
+
+static unsigned int Gcd(unsigned int a, unsigned int b) {
+	while (b) {
+		unsigned int r = a % b;
+		a = b;
+		b = r;
+	}
+	return a;
+}
+
+AionMiner::Source::Source(size_t solvers, unsigned int weight) :
+		weight(weight), deficit(0), nonce1Size(0), epoch { 0 },
+		cleanEpoch { 0 }, pauseEpoch { 0 }, acceptsStale { true },
+		startedEpoch(0), nonces { solvers } {
+}
+
+AionMiner::AionMiner(const std::vector<ISolver *> &i_solvers,
+		const std::vector<unsigned int> &weights) :
+		minerThreads { nullptr }, m_solutionPool { i_solvers.size() * SOLUTIONS_PER_THREAD },
+		m_solverPaused { new std::atomic<bool>[i_solvers.size()] },
+		m_cursor(0), m_jobEpoch { 0 } {
 	m_isActive = false;
 	solvers = i_solvers;
 	nThreads = solvers.size();
+	for (int i = 0; i < nThreads; ++i)
+		m_solverPaused[i] = false;
+
+	// 80/20 is taken as 4/1, so sources alternate in small turns
+	unsigned int divisor = 0;
+	for (unsigned int weight : weights)
+		divisor = Gcd(divisor, weight);
+	for (unsigned int weight : weights)
+		m_sources.emplace_back(new Source(solvers.size(),
+				weight && divisor ? weight / divisor : 1));
+	if (m_sources.empty())
+		m_sources.emplace_back(new Source(solvers.size(), 1));
 }
 
 AionMiner::~AionMiner() {
@@ -501,6 +399,8 @@ void AionMiner::start() {
 	}
 
 	m_isActive = true;
+	// Startup-to-first-hash latency is measured from here
+	speed.Reset();
 
 	minerThreads = new std::thread[nThreads];
 	minerThreadActive = new bool[nThreads];
@@ -513,7 +413,11 @@ void AionMiner::start() {
 	// #1 start cpu threads
 	// #2 start CUDA threads
 	// #3 start OPENCL threads
-	for (int i = 0; i < solvers.size(); ++i) {
+	for (size_t i = 0; i < solvers.size(); ++i) {
+		speed.InitSolver(i, solvers[i]->getname(), solvers[i]->getdevinfo());
+		speed.SetSolverPaused(i, m_solverPaused[i]);
+	}
+	for (size_t i = 0; i < solvers.size(); ++i) {
 		minerThreadActive[i] = true;
 		minerThreads[i] = std::thread(
 				boost::bind(&AionMinerThread, this, nThreads, i, solvers[i]));
@@ -548,8 +452,6 @@ void AionMiner::start() {
 	//for (int i = 0; i < nThreads; i++) {
 	//    minerThreads->create_thread(boost::bind(&ZcashMinerThread, this, nThreads, i));
 	//}*/
-
-	speed.Reset();
 }
 
 void AionMiner::stop() {
@@ -557,6 +459,9 @@ void AionMiner::stop() {
 	if (minerThreads) {
 		for (int i = 0; i < nThreads; i++)
 			minerThreadActive[i] = false;
+		// Wake threads waiting for work and cancel running solvers
+		for (size_t source = 0; source < m_sources.size(); ++source)
+			setJob(source, nullptr);
 		for (int i = 0; i < nThreads; i++)
 			minerThreads[i].join();
 		delete[] minerThreads;
@@ -571,31 +476,51 @@ void AionMiner::stop() {
 	 }*/
 }
 
-void AionMiner::setServerNonce(const std::string& n1str) {
+void AionMiner::setServerNonce(size_t source, const std::string& n1str) {
 	//auto n1str = params[1].get_str();
-	BOOST_LOG_TRIVIAL(info) << "miner | Extranonce is " << n1str;
+	BOOST_LOG_TRIVIAL(info) << "miner | Extranonce of source #" << source << " is " << n1str;
+	Source& s = *m_sources[source];
 	std::vector<unsigned char> nonceData(ParseHex(n1str));
 	while (nonceData.size() < 32) {
 		nonceData.push_back(0);
 	}
 	CDataStream ss(nonceData, SER_NETWORK, PROTOCOL_VERSION);
-	ss >> nonce1;
+	ss >> s.nonce1;
 
-	//BOOST_LOG_TRIVIAL(info) << "miner | Full nonce " << nonce1.ToString();
+	//BOOST_LOG_TRIVIAL(info) << "miner | Full nonce " << s.nonce1.ToString();
 
-	nonce1Size = n1str.size();
-	size_t nonce1Bits = nonce1Size * 4; // Hex length to bit length
+	s.nonce1Size = n1str.size();
+	size_t nonce1Bits = s.nonce1Size * 4; // Hex length to bit length
 	size_t nonce2Bits = 256 - nonce1Bits;
 
-	nonce2Space = 1;
-	nonce2Space <<= nonce2Bits;
-	nonce2Space -= 1;
+	s.nonce2Space = 1;
+	s.nonce2Space <<= nonce2Bits;
+	s.nonce2Space -= 1;
+
+	s.nonce2Inc = 1;
+	s.nonce2Inc <<= nonce1Bits;
+}
+
+void AionMiner::setShareTarget(size_t source, const uint256* target) {
+	std::shared_ptr<ShareTarget> shareTarget;
+	if (target) {
+		shareTarget = std::make_shared<ShareTarget>();
+		// uint256 stores the least significant byte first
+		for (size_t i = 0; i < sizeof(shareTarget->bytes); i++)
+			shareTarget->bytes[i] = target->begin()[sizeof(shareTarget->bytes) - 1 - i];
+	}
+	std::atomic_store(&m_sources[source]->shareTarget,
+			std::shared_ptr<const ShareTarget>(std::move(shareTarget)));
+}
 
-	nonce2Inc = 1;
-	nonce2Inc <<= nonce1Bits;
+bool AionMiner::meetsTarget(size_t source, const AionJob& job,
+		const unsigned char* hash) const {
+	std::shared_ptr<const ShareTarget> shareTarget =
+			std::atomic_load(&m_sources[source]->shareTarget);
+	return memcmp(hash, shareTarget ? shareTarget->bytes : job.targetBytes, 32) < 0;
 }
 
-AionJob* AionMiner::parseJob(const Array& params) {
+AionJob* AionMiner::parseJob(size_t source, const Array& params) {
 	if (params.size() < 2) {
 		throw std::logic_error("Invalid job params");
 	}
@@ -662,38 +587,215 @@ AionJob* AionMiner::parseJob(const Array& params) {
 
 	// ret->time = params[8].get_str();
 	ret->clean = params[1].get_bool();
+	ret->source = source;
+	ret->connection = 0;
 
-	ret->header.nNonce = nonce1;
-	ret->nonce1Size = nonce1Size;
-	ret->nonce2Space = nonce2Space;
-	ret->nonce2Inc = nonce2Inc;
+	const Source& s = *m_sources[source];
+	ret->header.nNonce = s.nonce1;
+	ret->nonce1Size = s.nonce1Size;
+	ret->nonce2Space = s.nonce2Space;
+	ret->nonce2Inc = s.nonce2Inc;
 
 	ret->setTarget(params[2].get_str());
+	ret->prepare();
 
 	return ret;
 }
 
-void AionMiner::setJob(AionJob* job) {
-	NewJob(job);
+void AionMiner::parseJob(size_t source, const StratumField& params,
+		AionJob& job) {
+	// Job id, clean flag, target and header hash
+	if (params.count != 4 || !params[0].is(StratumToken::Type::String)
+			|| !params[1].is(StratumToken::Type::Bool)
+			|| !params[2].is(StratumToken::Type::String)
+			|| params[3].size != 2 * ABlockHeader::HEADER_SIZE
+			|| !params[3].decodeHex(job.header.headerHash.begin())) {
+		throw std::logic_error("Invalid job params");
+	}
+	job.job.assign(params[0].data, params[0].size);
+	job.header.nSolution.clear();
+	job.clean = params[1].boolean;
+	job.source = source;
+	job.connection = 0;
+
+	const Source& s = *m_sources[source];
+	job.header.nNonce = s.nonce1;
+	job.nonce1Size = s.nonce1Size;
+	job.nonce2Space = s.nonce2Space;
+	job.nonce2Inc = s.nonce2Inc;
+
+	job.setTarget(params[2].data, params[2].size);
+	job.prepare();
+}
+
+// Number of nonce2 values the job leaves above nonce1
+static uint64_t NonceLimit(const AionJob* job) {
+	size_t nonce2Bits = 256 - job->nonce1Size * 4;
+	return nonce2Bits >= 64 ? UINT64_MAX : (uint64_t) 1 << nonce2Bits;
+}
+
+void AionMiner::setJob(size_t source, AionJob* job) {
+	// One copy for all threads instead of one per thread
+	std::shared_ptr<const AionJob> snapshot(job ? job->clone() : nullptr);
+	{
+		std::lock_guard<std::mutex> lock { m_jobMutex };
+		Source& s = *m_sources[source];
+		if (s.job && job && job->clean)
+			speed.AddJobChange();
+		s.job = std::move(snapshot);
+		s.jobTime = std::chrono::steady_clock::now();
+		uint64_t epoch = m_jobEpoch.load(std::memory_order_relaxed) + 1;
+		s.nonces.reset(epoch, job ? NonceLimit(job) : 0);
+		if (!job)
+			s.pauseEpoch.store(epoch, std::memory_order_release);
+		if (!job || job->clean)
+			s.cleanEpoch.store(epoch, std::memory_order_release);
+		s.epoch.store(epoch, std::memory_order_release);
+		m_jobEpoch.store(epoch, std::memory_order_release);
+	}
+	m_jobSignal.notify_all();
+}
+
+void AionMiner::advanceCursor() {
+	m_cursor = (m_cursor + 1) % m_sources.size();
+	// A source is topped up by its weight on its turn, an idle one keeps
+	// no credit
+	Source& s = *m_sources[m_cursor];
+	s.deficit = s.job ? s.deficit + s.weight : 0;
+}
+
+bool AionMiner::nextWork(int pos, size_t& source, uint64_t& epoch,
+		std::shared_ptr<const AionJob>& job, uint64_t& counter) {
+	std::unique_lock<std::mutex> lock { m_jobMutex };
+	while (minerThreadActive[pos]) {
+		if (m_solverPaused[pos]) {
+			BOOST_LOG_CUSTOM(debug, pos) << "Solver paused";
+			m_jobSignal.wait(lock, [this, pos]() {
+				return !m_solverPaused[pos] || !minerThreadActive[pos];
+			});
+			continue;
+		}
+
+		// Deficit round-robin, a nonce costs one. Every source gets a turn
+		// before the thread gives up.
+		for (size_t tried = 0; tried <= m_sources.size(); ++tried) {
+			Source& s = *m_sources[m_cursor];
+			uint64_t current = s.epoch.load(std::memory_order_relaxed);
+			if (s.job && s.deficit > 0 && s.nonces.next(pos, current, counter)) {
+				if (source != m_cursor || epoch != current) {
+					int64_t latency = std::chrono::duration_cast<std::chrono::microseconds>(
+							std::chrono::steady_clock::now() - s.jobTime).count();
+					BOOST_LOG_CUSTOM(debug, pos) << "Picked up job #" << s.job->jobId()
+							<< " of source #" << m_cursor << " after " << latency << " us";
+					if (s.startedEpoch != current) {
+						s.startedEpoch = current;
+						speed.AddJobLatency(latency);
+					}
+				}
+				source = m_cursor;
+				epoch = current;
+				job = s.job;
+				if (--s.deficit == 0)
+					advanceCursor();
+				return true;
+			}
+			// Paused, or its whole range is in use
+			s.deficit = 0;
+			advanceCursor();
+		}
+
+		// setJob and stop() wake the thread
+		BOOST_LOG_CUSTOM(debug, pos) << "Mining paused";
+		uint64_t seen = m_jobEpoch.load(std::memory_order_relaxed);
+		m_jobSignal.wait(lock, [this, pos, seen]() {
+			return m_jobEpoch.load(std::memory_order_relaxed) != seen
+					|| !minerThreadActive[pos];
+		});
+	}
+	return false;
+}
+
+void AionMiner::recordSolveTime(int pos, double seconds) {
+	for (std::unique_ptr<Source>& s : m_sources)
+		s->nonces.recordSolveTime(pos, seconds);
 }
 
 void AionMiner::onSolutionFound(
-		const std::function<
-				bool(const EquihashSolution&, const std::string&, uint64_t)> callback) {
+		const std::function<bool(EquihashSolution*)> callback) {
 	solutionFoundCallback = callback;
 }
 
-void AionMiner::submitSolution(const EquihashSolution& solution,
-		const std::string& jobid, uint64_t timestamp) {
-	solutionFoundCallback(solution, jobid, timestamp);
+bool AionMiner::pauseSolver(size_t pos, bool paused) {
+	if (pos >= solvers.size())
+		return false;
+	{
+		std::lock_guard<std::mutex> lock { m_jobMutex };
+		if (m_solverPaused[pos] == paused)
+			return true;
+		m_solverPaused[pos] = paused;
+	}
+	m_jobSignal.notify_all();
+	speed.SetSolverPaused(pos, paused);
+	BOOST_LOG_TRIVIAL(info) << "miner | " << (paused ? "Paused" : "Resumed")
+			<< " solver #" << pos << " (" << solvers[pos]->getname() << ")";
+	return true;
+}
+
+size_t AionMiner::getCpuSolverCount() const {
+	return std::count_if(solvers.begin(), solvers.end(),
+			[](const ISolver* solver) {return solver->GetType() == SolverType::CPU;});
+}
+
+void AionMiner::setCpuThreads(size_t count) {
+	size_t cpu = 0;
+	for (size_t pos = 0; pos < solvers.size(); ++pos)
+		if (solvers[pos]->GetType() == SolverType::CPU)
+			pauseSolver(pos, cpu++ >= count);
+}
+
+void AionMiner::submitSolution(EquihashSolution* solution,
+		const AionJob& job, uint64_t timestamp) {
+	solution->jobId = job.job;
+	solution->source = job.source;
+	solution->connection = job.connection;
+	solution->timestamp = timestamp;
+	solution->tag = 0;
 	speed.AddShare();
+	if (!solutionFoundCallback || !solutionFoundCallback(solution))
+		m_solutionPool.release(solution);
+}
+
+bool AionMiner::shouldAbort(int pos, size_t source, uint64_t epoch,
+		unsigned int done, unsigned int total) const {
+	if (isPaused(pos))
+		return true;
+	if (!isCancelled(source, epoch))
+		return false;
+	const Source& s = *m_sources[source];
+	if (!minerThreadActive[pos] || s.pauseEpoch.load(std::memory_order_acquire) > epoch)
+		return true;
+	// Progress is unknown until the thread has finished one run
+	return !(total && done * 100 >= total * STALE_FINISH_PERCENT
+			&& s.acceptsStale.load(std::memory_order_relaxed));
 }
 
-void AionMiner::acceptedSolution(bool stale) {
+void AionMiner::acceptedSolution(size_t source, bool stale, uint64_t tag) {
 	speed.AddShareOK();
+	if (stale) {
+		speed.StaleShareAnswered(true);
+		m_sources[source]->acceptsStale = true;
+	}
 }
 
-void AionMiner::rejectedSolution(bool stale) {
+void AionMiner::rejectedSolution(size_t source, bool stale, uint64_t tag,
+		const std::string& reason) {
+	speed.AddShareRejected();
+	if (stale) {
+		speed.StaleShareAnswered(false);
+		if (m_sources[source]->acceptsStale.exchange(false))
+			BOOST_LOG_TRIVIAL(info) << "miner | Pool of source #" << source
+					<< " rejects stale shares, its replaced jobs are cancelled at once";
+	}
 }
 
 void AionMiner::failedSolution() {
@@ -702,6 +804,7 @@ void AionMiner::failedSolution() {
 std::mutex benchmark_work;
 std::vector<uint256*> benchmark_nonces;
 std::atomic_int benchmark_solutions;
+std::atomic_int benchmark_invalid;
 
 bool benchmark_solve_equihash(const ABlock& pblock,
 		const char *tequihash_header, unsigned int tequihash_header_len,
@@ -718,21 +821,25 @@ bool benchmark_solve_equihash(const ABlock& pblock,
 	BOOST_LOG_TRIVIAL(debug) << "Testing, nonce = " << nonce->ToString();
 
 	std::function<
-			void(const std::vector<uint32_t>&, size_t, const unsigned char*)> solutionFound =
-			[&pblock, &nonce]
-			(const std::vector<uint32_t>& index_vector, size_t cbitlen, const unsigned char* compressed_sol)
+			void(const uint32_t*, size_t, const unsigned char*)> solutionFound =
+			[&nonce, tequihash_header, tequihash_header_len]
+			(const uint32_t* indices, size_t cbitlen, const unsigned char* compressed_sol)
 			{
-				ABlockHeader hdr = pblock.GetBlockHeader();
-				hdr.nNonce = *nonce;
+				unsigned char minimal[EQUIVERIFY_SOLUTION_BYTES];
+				if (!compressed_sol) {
+					CompressIndices(indices, 1 << EQUIVERIFY_K, cbitlen + 1, minimal);
+					compressed_sol = minimal;
+				}
 
-				if (compressed_sol)
-				{
-					hdr.nSolution = std::vector<unsigned char>(1408);
-					for (size_t i = 0; i < cbitlen; ++i)
-					hdr.nSolution[i] = compressed_sol[i];
+				// Check the solver output the same way the pool will
+				std::vector<unsigned char> input(tequihash_header, tequihash_header + tequihash_header_len);
+				input.insert(input.end(), nonce->begin(), nonce->end());
+				int code = equiverify_verify(input.data(), input.size(),
+						compressed_sol, EQUIVERIFY_SOLUTION_BYTES);
+				if (code != EQUIVERIFY_OK) {
+					BOOST_LOG_TRIVIAL(warning) << "Invalid solution: " << equiverify_strerror(code);
+					++benchmark_invalid;
 				}
-				else
-				hdr.nSolution = GetMinimalFromIndices(index_vector, cbitlen);
 
 				++benchmark_solutions;
 			};
@@ -789,6 +896,8 @@ void Solvers_doBenchmark(int hashes, const std::vector<ISolver *> &solvers) {
 			benchmark_nonces.back()->begin()[i] = std::rand() % 256;
 	}
 	benchmark_solutions = 0;
+	benchmark_invalid = 0;
+	equiverify_init();
 
 	size_t total_hashes = benchmark_nonces.size();
 
@@ -839,6 +948,7 @@ void Solvers_doBenchmark(int hashes, const std::vector<ISolver *> &solvers) {
 	BOOST_LOG_TRIVIAL(info) << "Total time : " << msec << " ms";
 	BOOST_LOG_TRIVIAL(info) << "Total iterations: " << hashes_done;
 	BOOST_LOG_TRIVIAL(info) << "Total solutions found: " << benchmark_solutions;
+	BOOST_LOG_TRIVIAL(info) << "Invalid solutions: " << benchmark_invalid;
 	BOOST_LOG_TRIVIAL(info) << "Speed: "
 			<< ((double) hashes_done * 1000 / (double) msec) << " I/s";
 	BOOST_LOG_TRIVIAL(info) << "Speed: "
@@ -9,34 +9,76 @@
 #include "uint256.h"
 //#include "util.h"
 
-#include <boost/signals2.hpp>
 //#include <boost/signals.hpp>
 //#include <boost/thread.hpp>
 #include <thread>
 #include <mutex>
+#include <memory>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
 
 #include "json/json_spirit_value.h"
 
 #include "ISolver.h"
+#include "NonceScheduler.h"
+#include "StratumMessage.h"
+#include "../../blake2/blake2.h"
+#include "../../equiverify/equiverify.h"
 
 using namespace json_spirit;
 
 extern int use_avx;
 extern int use_avx2;
 
+// Fixed size so solutions can be recycled through a SolutionPool
 struct EquihashSolution
 {
     uint256 nonce;
-	std::string time;
 	size_t nonce1size;
-    std::vector<unsigned char> solution;
-
-    EquihashSolution(uint256 n, std::vector<unsigned char> s, std::string t, size_t n1s)
-		: nonce{ n }, nonce1size{ n1s } { solution = s; time = t; }
+    unsigned char solution[EQUIVERIFY_SOLUTION_BYTES];
+	std::string jobId;
+	uint64_t timestamp; // big-endian seconds, as submitted
+	bool stale;         // a clean job had replaced its job when it was found
+	size_t source;      // miner job source, the pool it is submitted to
+	size_t connection;  // pool connection the job came from
+	uint64_t tag;       // set by the submitter, handed back with the answer
+	std::chrono::steady_clock::time_point queued;
+	std::atomic<EquihashSolution*> next; // MpscQueue link
 
     std::string toString() const { return nonce.GetHex(); }
+
+    // Stratum hex fields, appended to out without temporaries
+    void appendNonce2Hex(std::string& out) const;
+    void appendSolutionHex(std::string& out) const;
 };
 
+// Preallocated solution records shared by the mining threads
+#define SOLUTIONS_PER_THREAD 16
+
+// A run whose job is replaced may finish once it is this far through its
+// cancellation checkpoints, if the pool accepts shares of replaced jobs
+#define STALE_FINISH_PERCENT 80
+
+class SolutionPool
+{
+	std::vector<EquihashSolution> m_records;
+	std::vector<EquihashSolution*> m_free;
+	std::mutex m_mutex;
+
+public:
+	explicit SolutionPool(size_t capacity);
+
+	// Returns nullptr when every record is in use
+	EquihashSolution* acquire();
+	void release(EquihashSolution* solution);
+};
+
+// Packs count indices of bitLen bits each into the big-endian minimal
+// solution encoding, out must hold count * bitLen / 8 bytes
+void CompressIndices(const uint32_t* indices, size_t count, size_t bitLen,
+		unsigned char* out);
+
 struct AionJob
 {
     std::string job;
@@ -47,9 +89,17 @@ struct AionJob
     arith_uint256 nonce2Inc;
     arith_uint256 serverTarget;
     bool clean;
+    size_t source;     // miner job source it was set on
+    size_t connection; // pool connection that sent the job
     std::string serverTarget_str;
     uint32_t *target;
 
+    // Prepared once per job so the nonce loop and solution check do not
+    // serialize or parse anything
+    unsigned char input[ABlockHeader::HEADER_SIZE]; // Equihash input before the nonce
+    blake2b_state shareState;                        // share hash state, input absorbed
+    unsigned char targetBytes[32];                   // serverTarget, big-endian
+
     AionJob* clone() const;
     bool equals(const AionJob& a) const { return job == a.job; }
 
@@ -58,10 +108,18 @@ struct AionJob
     bool cleanJobs() const { return clean; }
 
     void setTarget(std::string target);
+    // Same from hex that need not be terminated
+    void setTarget(const char* hex, size_t size);
 
     void setTarget();
 
-    void diffToTarget(uint32_t *target, double diff);
+    /**
+     * Fills input, shareState and targetBytes from header and serverTarget.
+     */
+    void prepare();
+
+    // Writes the 32 byte big-endian target of a stratum difficulty
+    static void diffToTarget(uint32_t *target, double diff);
     
     /**
      * Checks whether the given solution satisfies this work order.
@@ -80,40 +138,131 @@ inline bool operator==(const AionJob& a, const AionJob& b)
     return a.equals(b);
 }
 
-typedef boost::signals2::signal<void (const AionJob*)> NewJob_t;
-
 class AionMiner
 {
     int nThreads;
 	std::thread* minerThreads;
     //boost::thread_group* minerThreads;
-    uint256 nonce1;
-    size_t nonce1Size;
-    arith_uint256 nonce2Space;
-    arith_uint256 nonce2Inc;
-    std::function<bool(const EquihashSolution&, const std::string&, uint64_t)> solutionFoundCallback;
+    std::function<bool(EquihashSolution*)> solutionFoundCallback;
 	bool m_isActive;
 
 	std::vector<ISolver *> solvers;
+	SolutionPool m_solutionPool;
+	// By thread, set under m_jobMutex. A paused thread drops its run and
+	// waits, its solver keeps whatever it holds.
+	std::unique_ptr<std::atomic<bool>[]> m_solverPaused;
+
+	struct ShareTarget
+	{
+		unsigned char bytes[32];
+	};
+
+	// Jobs of one pool. Pools share the solvers by weight.
+	struct Source
+	{
+		unsigned int weight;
+		// Nonces the source may still take before the next one's turn
+		unsigned int deficit;
+
+		uint256 nonce1;
+		size_t nonce1Size;
+		arith_uint256 nonce2Space;
+		arith_uint256 nonce2Inc;
+
+		// Current job, replaced as a whole by setJob and never modified
+		// once published. A null job pauses the source.
+		std::shared_ptr<const AionJob> job;
+		std::chrono::steady_clock::time_point jobTime;
+		// Epoch of the current job, threads compare it against the epoch
+		// of the job they are working on
+		std::atomic<uint64_t> epoch;
+		// Epoch of the last clean job or pause, running solvers older than
+		// it are cancelled
+		std::atomic<uint64_t> cleanEpoch;
+		// Epoch of the last pause, which cancels every run outright
+		std::atomic<uint64_t> pauseEpoch;
+		// Outcome of the last stale share, optimistic until one is answered
+		std::atomic<bool> acceptsStale;
+		// Share target of the pool, big-endian, replaced as a whole with
+		// std::atomic_store. Null while the job target applies.
+		std::shared_ptr<const ShareTarget> shareTarget;
+		// Epoch of the last job a thread started on, for the job latency
+		uint64_t startedEpoch;
+		NonceScheduler nonces;
+
+		Source(size_t solvers, unsigned int weight);
+	};
+	std::vector<std::unique_ptr<Source>> m_sources;
+	// Source whose turn it is in the deficit round-robin
+	size_t m_cursor;
+
+	// Bumped by every setJob of any source, so epochs are unique across
+	// sources and threads without work can tell when some arrives
+	std::atomic<uint64_t> m_jobEpoch;
+	// Guards the jobs and the round-robin state, threads waiting for work
+	// sleep on m_jobSignal
+	std::mutex m_jobMutex;
+	std::condition_variable m_jobSignal;
+
+	void advanceCursor();
 
 public:
-    NewJob_t NewJob;
 	bool* minerThreadActive;
 
-	AionMiner(const std::vector<ISolver *> &i_solvers);
+	// One job source per weight, solver time is split between them in
+	// proportion to the weights
+	AionMiner(const std::vector<ISolver *> &i_solvers,
+			const std::vector<unsigned int> &weights = std::vector<unsigned int>(1, 1));
 	~AionMiner();
 
     std::string userAgent();
     void start();
     void stop();
 	bool isMining() { return m_isActive; }
-	void setServerNonce(const std::string& n1str);
-    AionJob* parseJob(const Array& params);
-    void setJob(AionJob* job);
-	void onSolutionFound(const std::function<bool(const EquihashSolution&, const std::string&, uint64_t timestamp)> callback);
-	void submitSolution(const EquihashSolution& solution, const std::string& jobid, uint64_t timestamp);
-    void acceptedSolution(bool stale);
-    void rejectedSolution(bool stale);
+	size_t getSourceCount() const { return m_sources.size(); }
+	unsigned int getWeight(size_t source) const { return m_sources[source]->weight; }
+	void setServerNonce(size_t source, const std::string& n1str);
+	// Solutions of the source are checked against target instead of the
+	// job target from then on, including those of running solvers. A null
+	// target goes back to the job target.
+	void setShareTarget(size_t source, const uint256* target);
+	// Whether the big-endian share hash is below the share target of the
+	// source, or the target of job while the source has none
+	bool meetsTarget(size_t source, const AionJob& job, const unsigned char* hash) const;
+    AionJob* parseJob(size_t source, const Array& params);
+	// Fills job from the params of a parsed notify, reusing its storage.
+	// Throws std::logic_error on invalid params, as the above.
+	void parseJob(size_t source, const StratumField& params, AionJob& job);
+    void setJob(size_t source, AionJob* job);
+	// Blocks until some source has work and picks the next nonce for
+	// thread pos, taking sources in turn by weight. source and epoch hold
+	// what the thread worked on last. Returns false when thread pos has
+	// been stopped.
+	bool nextWork(int pos, size_t& source, uint64_t& epoch,
+			std::shared_ptr<const AionJob>& job, uint64_t& counter);
+	bool isCancelled(size_t source, uint64_t epoch) const { return m_sources[source]->cleanEpoch.load(std::memory_order_acquire) > epoch; }
+	// Whether thread pos should abort its run of the job with this epoch
+	// at checkpoint done of about total in a full run. A cancelled run close
+	// to its end finishes while the pool accepts stale shares.
+	bool shouldAbort(int pos, size_t source, uint64_t epoch, unsigned int done, unsigned int total) const;
+	// pos is the solver index the API and the status show, from any thread.
+	// Returns false if there is no such solver.
+	bool pauseSolver(size_t pos, bool paused);
+	bool isPaused(int pos) const { return m_solverPaused[pos].load(std::memory_order_relaxed); }
+	size_t getCpuSolverCount() const;
+	// Runs the first count CPU solvers and pauses the others
+	void setCpuThreads(size_t count);
+	void recordSolveTime(int pos, double seconds);
+	// The callback takes ownership of the solution when it returns true and
+	// must hand it back through releaseSolution
+	void onSolutionFound(const std::function<bool(EquihashSolution* solution)> callback);
+	EquihashSolution* acquireSolution() { return m_solutionPool.acquire(); }
+	void releaseSolution(EquihashSolution* solution) { m_solutionPool.release(solution); }
+	// Hands the solution to the callback, or returns it to the pool
+	void submitSolution(EquihashSolution* solution, const AionJob& job, uint64_t timestamp);
+	// The pool's answer to a share, tag is the solution's, unused here
+    void acceptedSolution(size_t source, bool stale, uint64_t tag);
+    void rejectedSolution(size_t source, bool stale, uint64_t tag, const std::string& reason);
     void failedSolution();
 };
 
@@ -0,0 +1,69 @@
+#pragma once
+// Copyright (c) 2018 Aion Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <atomic>
+#include <cstddef>
+
+/**
+ * Intrusive multi-producer single-consumer queue (Vyukov). T needs a
+ * std::atomic<T*> next member and a default constructor for the stub node.
+ * push may be called from any thread and never blocks, pop and size only
+ * from the single consumer.
+ */
+template <typename T>
+class MpscQueue
+{
+	std::atomic<T*> m_head; // last pushed node, shared by producers
+	T* m_tail;              // next node to pop, consumer only
+	T m_stub;
+	std::atomic<size_t> m_size;
+
+	void link(T* node) {
+		node->next.store(nullptr, std::memory_order_relaxed);
+		T* prev = m_head.exchange(node, std::memory_order_acq_rel);
+		prev->next.store(node, std::memory_order_release);
+	}
+
+public:
+	MpscQueue() : m_head { &m_stub }, m_tail { &m_stub }, m_size { 0 } {
+		m_stub.next.store(nullptr, std::memory_order_relaxed);
+	}
+
+	MpscQueue(const MpscQueue&) = delete;
+	MpscQueue& operator=(const MpscQueue&) = delete;
+
+	void push(T* node) {
+		link(node);
+		m_size.fetch_add(1, std::memory_order_release);
+	}
+
+	// Returns nullptr when empty or while a concurrent push has not linked
+	// its node yet, in which case size() stays non-zero
+	T* pop() {
+		T* tail = m_tail;
+		T* next = tail->next.load(std::memory_order_acquire);
+		if (tail == &m_stub) {
+			if (!next)
+				return nullptr;
+			m_tail = next;
+			tail = next;
+			next = next->next.load(std::memory_order_acquire);
+		}
+		if (!next) {
+			if (tail != m_head.load(std::memory_order_acquire))
+				return nullptr;
+			// tail is the last node, put the stub behind it so it can go
+			link(&m_stub);
+			next = tail->next.load(std::memory_order_acquire);
+			if (!next)
+				return nullptr;
+		}
+		m_tail = next;
+		m_size.fetch_sub(1, std::memory_order_relaxed);
+		return tail;
+	}
+
+	size_t size() const { return m_size.load(std::memory_order_acquire); }
+};
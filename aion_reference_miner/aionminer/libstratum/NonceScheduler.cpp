@@ -0,0 +1,66 @@
+// Copyright (c) 2018 Aion Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "NonceScheduler.h"
+
+#include <algorithm>
+
+NonceScheduler::NonceScheduler(size_t solvers) :
+		m_epoch(0), m_next(0), m_limit(0), m_ranges(solvers, Range { 0, 0, 0 }) {
+}
+
+uint64_t NonceScheduler::chunkSize(const Range& range) const {
+	if (range.secondsPerNonce <= 0)
+		return 1;
+	double chunk = NONCE_CHUNK_SECONDS / range.secondsPerNonce;
+	return chunk < 1 ? 1 : (uint64_t) std::min(chunk, 1e9);
+}
+
+void NonceScheduler::reset(uint64_t epoch, uint64_t limit) {
+	std::lock_guard<std::mutex> lock { m_mutex };
+	m_epoch = epoch;
+	m_next = 0;
+	m_limit = limit;
+	for (Range& range : m_ranges)
+		range.next = range.end = 0;
+}
+
+bool NonceScheduler::next(size_t pos, uint64_t epoch, uint64_t& counter) {
+	std::lock_guard<std::mutex> lock { m_mutex };
+	if (epoch != m_epoch)
+		return false;
+
+	Range& own = m_ranges[pos];
+	if (own.next == own.end) {
+		if (m_next < m_limit) {
+			own.next = m_next;
+			own.end = m_next + std::min(chunkSize(own), m_limit - m_next);
+			m_next = own.end;
+		} else {
+			// Steal the upper half of the largest range left
+			Range* victim = nullptr;
+			for (Range& range : m_ranges) {
+				if (range.end - range.next > 1
+						&& (!victim || range.end - range.next > victim->end - victim->next))
+					victim = &range;
+			}
+			if (!victim)
+				return false;
+			uint64_t split = victim->next + (victim->end - victim->next) / 2;
+			own.next = split;
+			own.end = victim->end;
+			victim->end = split;
+		}
+	}
+
+	counter = own.next++;
+	return true;
+}
+
+void NonceScheduler::recordSolveTime(size_t pos, double seconds) {
+	std::lock_guard<std::mutex> lock { m_mutex };
+	Range& range = m_ranges[pos];
+	range.secondsPerNonce = range.secondsPerNonce > 0 ?
+			0.8 * range.secondsPerNonce + 0.2 * seconds : seconds;
+}
@@ -0,0 +1,51 @@
+#pragma once
+// Copyright (c) 2018 Aion Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Seconds of work a solver is given per chunk at its measured speed
+#define NONCE_CHUNK_SECONDS 10
+
+/**
+ * Hands out nonce2 counters of the current job to the mining threads.
+ *
+ * Each solver takes chunks of consecutive counters from the job's shared
+ * range, sized so a chunk lasts about NONCE_CHUNK_SECONDS at the solver's
+ * measured speed. Once the shared range is used up, a solver that runs out
+ * takes the upper half of the largest range another solver has left.
+ * Ranges are only ever split, so no counter is handed out twice per job.
+ */
+class NonceScheduler
+{
+	struct Range
+	{
+		uint64_t next;
+		uint64_t end;
+		double secondsPerNonce; // moving average, 0 until measured
+	};
+
+	std::mutex m_mutex;
+	uint64_t m_epoch;
+	uint64_t m_next;  // start of the unassigned part of the job's range
+	uint64_t m_limit; // counters of the job are below m_limit
+	std::vector<Range> m_ranges;
+
+	uint64_t chunkSize(const Range& range) const;
+
+public:
+	explicit NonceScheduler(size_t solvers);
+
+	// Starts handing out counters [0, limit) of the job with this epoch
+	void reset(uint64_t epoch, uint64_t limit);
+
+	// Next counter for solver pos. Returns false once the job with this
+	// epoch has been replaced or its whole range is in use.
+	bool next(size_t pos, uint64_t epoch, uint64_t& counter);
+
+	// Records how long solver pos took for one nonce
+	void recordSolveTime(size_t pos, double seconds);
+};
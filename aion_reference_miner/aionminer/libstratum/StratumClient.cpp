@@ -10,455 +10,843 @@
 #include <byteswap.h>
 #include <iostream>
 #include <iomanip>
+#include <cinttypes>
+#include "speed.hpp"
 
 #include "utilstrencodings.h"
 
-#include "json/json_spirit_reader_template.h"
-#include "json/json_spirit_utils.h"
-
 using boost::asio::ip::tcp;
-using namespace json_spirit;
 
 #include <boost/log/trivial.hpp>
 
 #define BOOST_LOG_CUSTOM(sev) BOOST_LOG_TRIVIAL(sev) << "stratum | "
 
+// Bounds the resolve, connect, subscribe and authorize steps
+#define CONNECT_TIMEOUT_SECONDS 10
+// Reconnect delay, doubled after every failed attempt
+#define RECONNECT_DELAY_MIN_MS 250
+#define RECONNECT_DELAY_MAX_MS 3000
+// Shares the pool has not answered yet, past this they are forgotten
+#define MAX_PENDING_SHARES 1024
+// Ids 1 to 4 are the subscribe, authorize and capability requests
+#define FIRST_SHARE_ID 5
+// Starts a binary submit frame, a JSON line cannot begin with it
+#define BINARY_SUBMIT_MARKER 0x02
+
+template<typename Miner, typename Job, typename Solution>
+StratumClient<Miner, Job, Solution>::Connection::Connection(
+		boost::asio::io_service& io_service, size_t index, const cred_t& cred) :
+		index(index), pool(0), cred(cred), state(State::Idle), resolver(io_service),
+		socket(io_service), generation(0), shareId(FIRST_SHARE_ID),
+		binarySubmit(false), worktimer(io_service),
+		timerSerial(0), reconnectDelay(RECONNECT_DELAY_MIN_MS),
+		hasShareTarget(false) {
+}
+
 template<typename Miner, typename Job, typename Solution>
 StratumClient<Miner, Job, Solution>::StratumClient(
 		std::shared_ptr<boost::asio::io_service> io_s, Miner * m,
 		string const & host, string const & port, string const & user,
-		string const & pass, int const & retries, int const & worktimeout) :
-		m_socket(*io_s) {
+		string const & pass, int const & worktimeout,
+		size_t source) :
+		m_running(true), m_disconnected(false), m_source(source), m_submitPosted(false) {
 	m_io_service = io_s;
 
-	m_primary.host = host;
-	m_primary.port = port;
-	m_primary.user = user;
-	m_primary.pass = pass;
-
-	p_active = &m_primary;
-
-	m_authorized = false;
-	m_connected = false;
-	m_maxRetries = retries;
 	m_worktimeout = worktimeout;
 
 	p_miner = m;
 	p_current = nullptr;
-	p_previous = nullptr;
-	p_worktimer = nullptr;
+	p_active = nullptr;
+	m_preferred = 0;
+	m_lost = false;
+
+	cred_t primary { host, port, user, pass };
+	m_connections.emplace_back(new Connection(*io_s, 0, primary));
 
 	startWorking();
 }
 
+template<typename Miner, typename Job, typename Solution>
+StratumClient<Miner, Job, Solution>::~StratumClient() {
+	disconnect();
+	if (m_ioThread && m_ioThread->joinable())
+		m_ioThread->join();
+}
+
 template<typename Miner, typename Job, typename Solution>
 void StratumClient<Miner, Job, Solution>::setFailover(string const & host,
 		string const & port) {
-	setFailover(host, port, p_active->user, p_active->pass);
+	setFailover(host, port, m_connections[0]->cred.user,
+			m_connections[0]->cred.pass);
 }
 
 template<typename Miner, typename Job, typename Solution>
 void StratumClient<Miner, Job, Solution>::setFailover(string const & host,
 		string const & port, string const & user, string const & pass) {
-	m_failover.host = host;
-	m_failover.port = port;
-	m_failover.user = user;
-	m_failover.pass = pass;
+	cred_t failover { host, port, user, pass };
+	m_io_service->post([this, failover]() {
+		addConnection(failover);
+	});
 }
 
 template<typename Miner, typename Job, typename Solution>
 void StratumClient<Miner, Job, Solution>::startWorking() {
-	m_work.reset(new std::thread([&]() {
-		this->workLoop();
+	if (!p_miner->isMining()) {
+		BOOST_LOG_CUSTOM(info) << "Starting miner";
+		p_miner->start();
+	}
+	m_connections[0]->pool = speed.AddPool(m_connections[0]->name(), m_source,
+			p_miner->getWeight(m_source));
+
+	m_ioWork.reset(new boost::asio::io_service::work(*m_io_service));
+	m_io_service->post(boost::bind(&StratumClient::resolve, this,
+			m_connections[0].get()));
+	m_ioThread.reset(new std::thread([this]() {
+		while (true) {
+			try {
+				m_io_service->run();
+				break;
+			} catch (std::exception const& _e) {
+				// Last resort, onRead already restarts the connection whose
+				// message failed. Which one this was is unknown, so none is
+				// torn down.
+				BOOST_LOG_CUSTOM(error) << _e.what();
+			}
+		}
 	}));
 }
 
 template<typename Miner, typename Job, typename Solution>
-void StratumClient<Miner, Job, Solution>::workLoop() {
-	if (!p_miner->isMining()) {
-		BOOST_LOG_CUSTOM(info) << "Starting miner";
-		p_miner->start();
+void StratumClient<Miner, Job, Solution>::addConnection(const cred_t& cred) {
+	if (!m_running)
+		return;
+	if (m_connections.size() > 1) {
+		BOOST_LOG_CUSTOM(warning) << "Only one failover pool is supported, ignoring "
+				<< cred.host << ":" << cred.port;
+		return;
 	}
+	Connection* c = new Connection(*m_io_service, m_connections.size(), cred);
+	m_connections.emplace_back(c);
+	c->pool = speed.AddPool(c->name(), m_source, p_miner->getWeight(m_source));
+	BOOST_LOG_CUSTOM(info) << "Keeping " << c->name() << " as standby pool";
+	resolve(c);
+}
 
-	while (m_running) {
-		try {
-			if (!m_connected) {
-				//m_io_service.run();
-				//boost::thread t(boost::bind(&boost::asio::io_service::run, &m_io_service));
-				connect();
+template<typename Miner, typename Job, typename Solution>
+void StratumClient<Miner, Job, Solution>::resolve(Connection* c) {
+	if (!m_running)
+		return;
+	c->state = State::Resolving;
+	BOOST_LOG_CUSTOM(info) << "Connecting to stratum server " << c->name();
+	armTimer(c, CONNECT_TIMEOUT_SECONDS * 1000);
+
+	tcp::resolver::query q(c->cred.host, c->cred.port);
+	c->resolver.async_resolve(q,
+			boost::bind(&StratumClient::onResolved, this, c, c->generation,
+					boost::asio::placeholders::error,
+					boost::asio::placeholders::iterator));
+}
 
-			}
-			read_until(m_socket, m_responseBuffer, "\n");
-			std::istream is(&m_responseBuffer);
-			std::string response;
-			getline(is, response);
-
-			BOOST_LOG_CUSTOM(trace) << "Received: " << response;
-
-			if (!response.empty() && response.front() == '{'
-					&& response.back() == '}') {
-				Value valResponse;
-				if (read_string(response, valResponse)
-						&& valResponse.type() == obj_type) {
-					const Object& responseObject = valResponse.get_obj();
-					if (!responseObject.empty()) {
-						processReponse(responseObject);
-						m_response = response;
-					} else {
-						//LogS("[WARN] Response was empty\n");
-					}
-				} else {
-					//LogS("[WARN] Parse response failed\n");
-				}
-			} else {
-				//LogS("[WARN] Discarding incomplete response\n");
-			}
+template<typename Miner, typename Job, typename Solution>
+void StratumClient<Miner, Job, Solution>::onResolved(Connection* c,
+		unsigned int generation, const boost::system::error_code& ec,
+		tcp::resolver::iterator endpoints) {
+	if (generation != c->generation || c->state != State::Resolving)
+		return;
+	if (ec) {
+		BOOST_LOG_CUSTOM(error) << "Could not resolve stratum server "
+				<< c->name() << ", " << ec.message();
+		reconnect(c);
+		return;
+	}
+	c->state = State::Connecting;
+	boost::asio::async_connect(c->socket, endpoints,
+			boost::bind(&StratumClient::onConnected, this, c, generation,
+					boost::asio::placeholders::error));
+}
+
+template<typename Miner, typename Job, typename Solution>
+void StratumClient<Miner, Job, Solution>::onConnected(Connection* c,
+		unsigned int generation, const boost::system::error_code& ec) {
+	if (generation != c->generation || c->state != State::Connecting)
+		return;
+	if (ec) {
+		BOOST_LOG_CUSTOM(error) << "Could not connect to stratum server "
+				<< c->name() << ", " << ec.message();
+		reconnect(c);
+		return;
+	}
+
+	BOOST_LOG_CUSTOM(info) << "Connected to " << c->name();
+	boost::system::error_code ignored;
+	c->socket.set_option(tcp::no_delay(true), ignored);
+	c->state = State::Subscribing;
+	c->shareId = FIRST_SHARE_ID;
+	c->binarySubmit = false;
+
+	std::stringstream ss;
+	ss << "{\"id\":1,\"method\":\"mining.subscribe\",\"params\":[\""
+			<< p_miner->userAgent() << "\", null,\"" << c->cred.host
+			<< "\",\"" << c->cred.port << "\"]}\n";
+	send(c, ss.str());
+	readResponse(c);
+}
+
+template<typename Miner, typename Job, typename Solution>
+void StratumClient<Miner, Job, Solution>::readResponse(Connection* c) {
+	boost::asio::async_read_until(c->socket, c->responseBuffer, "\n",
+			boost::bind(&StratumClient::onRead, this, c, c->generation,
+					boost::asio::placeholders::error,
+					boost::asio::placeholders::bytes_transferred));
+}
+
+template<typename Miner, typename Job, typename Solution>
+void StratumClient<Miner, Job, Solution>::onRead(Connection* c,
+		unsigned int generation, const boost::system::error_code& ec,
+		size_t length) {
+	if (generation != c->generation)
+		return;
+	if (ec) {
+		BOOST_LOG_CUSTOM(warning) << "Connection to " << c->name()
+				<< " lost, " << ec.message();
+		reconnect(c);
+		return;
+	}
+
+	// One line per handler, the next read completes at once if the buffer
+	// already holds another. The line is parsed where asio put it, a
+	// streambuf keeps its data contiguous.
+	const char* line = boost::asio::buffer_cast<const char*>(
+			c->responseBuffer.data());
+	size_t size = length - 1;
+
+	BOOST_LOG_CUSTOM(trace) << "Received: " << std::string(line, size);
+
+	if (ParseStratumMessage(line, size, m_message)) {
+		try {
+			processReponse(c, m_message, line, size);
 		} catch (std::exception const& _e) {
-			BOOST_LOG_CUSTOM(warning) << _e.what();
-			reconnect();
+			// Only the pool that sent it starts over, the other keeps mining
+			BOOST_LOG_CUSTOM(warning) << "Invalid message from " << c->name()
+					<< ", " << _e.what();
+			reconnect(c);
+			return;
 		}
+	} else {
+		//LogS("[WARN] Parse response failed\n");
+	}
+
+	// The response may have closed this connection, which empties the buffer
+	if (generation == c->generation) {
+		c->responseBuffer.consume(length);
+		readResponse(c);
 	}
 }
 
 template<typename Miner, typename Job, typename Solution>
-void StratumClient<Miner, Job, Solution>::connect() {
-	BOOST_LOG_CUSTOM(info) << "Connecting to stratum server " << p_active->host
-			<< ":" << p_active->port;
-
-	tcp::resolver r(*m_io_service);
-	tcp::resolver::query q(p_active->host, p_active->port);
-	tcp::resolver::iterator endpoint_iterator = r.resolve(q);
-	tcp::resolver::iterator end;
-
-	boost::system::error_code error = boost::asio::error::host_not_found;
-	while (error && endpoint_iterator != end) {
-		m_socket.close();
-		m_socket.connect(*endpoint_iterator++, error);
+void StratumClient<Miner, Job, Solution>::armTimer(Connection* c,
+		int milliseconds) {
+	unsigned int serial = ++c->timerSerial;
+	c->worktimer.expires_from_now(boost::posix_time::milliseconds(milliseconds));
+	c->worktimer.async_wait(
+			boost::bind(&StratumClient::onTimer, this, c, serial,
+					boost::asio::placeholders::error));
+}
+
+template<typename Miner, typename Job, typename Solution>
+void StratumClient<Miner, Job, Solution>::cancelTimer(Connection* c) {
+	++c->timerSerial;
+	c->worktimer.cancel();
+}
+
+template<typename Miner, typename Job, typename Solution>
+void StratumClient<Miner, Job, Solution>::onTimer(Connection* c,
+		unsigned int serial, const boost::system::error_code& ec) {
+	// A timer that was re-armed or cancelled may still complete normally
+	if (ec || serial != c->timerSerial)
+		return;
+	switch (c->state) {
+	case State::Waiting:
+		resolve(c);
+		break;
+	case State::Working:
+		BOOST_LOG_CUSTOM(warning) << "No new work received from " << c->name()
+				<< " in " << m_worktimeout << " seconds";
+		reconnect(c);
+		break;
+	case State::Resolving:
+	case State::Connecting:
+	case State::Subscribing:
+	case State::Authorizing:
+		BOOST_LOG_CUSTOM(warning) << "Stratum server " << c->name()
+				<< " did not answer in " << CONNECT_TIMEOUT_SECONDS << " seconds";
+		reconnect(c);
+		break;
+	default:
+		break;
 	}
-	if (error) {
-		BOOST_LOG_CUSTOM(error) << "Could not connect to stratum server "
-				<< p_active->host << ":" << p_active->port << ", "
-				<< error.message();
-		reconnect();
-	} else {
-		BOOST_LOG_CUSTOM(info) << "Connected!";
-		m_connected = true;
-		std::stringstream ss;
-		ss << "{\"id\":1,\"method\":\"mining.subscribe\",\"params\":[\""
-				<< p_miner->userAgent() << "\", null,\"" << p_active->host
-				<< "\",\"" << p_active->port << "\"]}\n";
-		std::string sss = ss.str();
-		std::ostream os(&m_requestBuffer);
-		os << sss;
-		BOOST_LOG_CUSTOM(trace) << "Sending: " << sss;
-		write(m_socket, m_requestBuffer);
-
-		m_share_id = 4;
+}
+
+template<typename Miner, typename Job, typename Solution>
+void StratumClient<Miner, Job, Solution>::closeSocket(Connection* c) {
+	++c->generation;
+	speed.SetPoolConnected(c->pool, false);
+	c->resolver.cancel();
+	boost::system::error_code ignored;
+	c->socket.close(ignored);
+	c->responseBuffer.consume(c->responseBuffer.size());
+	// A batch being written stays until its handler returns the buffers
+	for (Request& request : c->writeQueue) {
+		if (request.id)
+			speed.SubmitDropped();
+		m_spare.push_back(std::move(request.data));
 	}
+	c->writeQueue.clear();
+	c->pendingShares.clear();
+	c->lastNotify.clear();
+	c->hasShareTarget = false;
 }
 
 template<typename Miner, typename Job, typename Solution>
-void StratumClient<Miner, Job, Solution>::reconnect() {
-	/*if (p_miner->isMining()) {
-	 BOOST_LOG_CUSTOM(info) << "Stopping miner";
-	 p_miner->stop();
-	 }*/
-	p_miner->setJob(nullptr);
-
-	if (p_worktimer) {
-		p_worktimer->cancel();
-		p_worktimer = nullptr;
+void StratumClient<Miner, Job, Solution>::reconnect(Connection* c) {
+	if (!m_running)
+		return;
+
+	closeSocket(c);
+
+	if (c == p_active) {
+		// Hand the solvers to a pool that is up, pause them if there is none
+		p_active = nullptr;
+		m_lost = true;
+		m_lostAt = std::chrono::steady_clock::now();
+		for (std::unique_ptr<Connection>& other : m_connections) {
+			if (other->state == State::Working && !other->lastNotify.empty()) {
+				activate(other.get());
+				break;
+			}
+		}
+		if (!p_active)
+			p_miner->setJob(m_source, nullptr);
+		speed.SetPoolActive(c->pool, false);
 	}
 
-	//m_io_service.reset();
-	//m_socket.close(); // leads to crashes on Linux
-	m_authorized = false;
-	m_connected = false;
+	c->state = State::Waiting;
+	BOOST_LOG_CUSTOM(info) << "Reconnecting to " << c->name() << " in "
+			<< c->reconnectDelay << " ms...";
+	armTimer(c, c->reconnectDelay);
+	c->reconnectDelay = std::min(c->reconnectDelay * 2, RECONNECT_DELAY_MAX_MS);
+}
 
-	if (!m_failover.host.empty()) {
-		m_retries++;
+template<typename Miner, typename Job, typename Solution>
+void StratumClient<Miner, Job, Solution>::stopSource() {
+	BOOST_LOG_CUSTOM(error) << "Stopped mining for source #" << m_source;
+	m_running = false;
+	for (std::unique_ptr<Connection>& other : m_connections) {
+		closeSocket(other.get());
+		cancelTimer(other.get());
+		other->state = State::Stopped;
+	}
+	if (p_active)
+		speed.SetPoolActive(p_active->pool, false);
+	p_active = nullptr;
+	p_current = nullptr;
+	// Deficit round-robin skips a source without a job
+	p_miner->setJob(m_source, nullptr);
+}
 
-		if (m_retries > m_maxRetries) {
-			if (m_failover.host == "exit") {
-				disconnect();
+template<typename Miner, typename Job, typename Solution>
+void StratumClient<Miner, Job, Solution>::activate(Connection* c) {
+	if (p_active != c) {
+		BOOST_LOG_CUSTOM(info) << CL_CYN "Mining on " << (c->index ? "standby" : "primary")
+				<< " pool " << c->name() << CL_N;
+		if (p_active)
+			speed.SetPoolActive(p_active->pool, false);
+		p_active = c;
+		speed.SetPoolActive(c->pool, true);
+	}
+	if (c->extranonce != m_minerExtranonce) {
+		p_miner->setServerNonce(m_source, c->extranonce);
+		m_minerExtranonce = c->extranonce;
+	}
+	p_miner->setShareTarget(m_source, c->hasShareTarget ? &c->shareTarget : nullptr);
+	// Jobs of the previous pool are useless, the last one here replaces them
+	p_current = nullptr;
+	StratumMessage notify;
+	if (ParseStratumMessage(c->lastNotify.data(), c->lastNotify.size(), notify))
+		setJob(c, notify.params, true);
+
+	if (m_lost) {
+		m_lost = false;
+		int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - m_lostAt).count();
+		speed.AddPoolSwitch(us);
+		BOOST_LOG_CUSTOM(info) << "Switched pools in " << us / 1000.0 << " ms";
+	}
+}
+
+template<typename Miner, typename Job, typename Solution>
+void StratumClient<Miner, Job, Solution>::setShareTarget(Connection* c,
+		const uint256& target) {
+	BOOST_LOG_CUSTOM(info) << CL_MAG "Target set to " << target.GetHex()
+			<< " by " << c->name() << CL_N;
+	c->hasShareTarget = true;
+	c->shareTarget = target;
+	// Running solvers check their solutions against it from now on
+	if (c == p_active)
+		p_miner->setShareTarget(m_source, &target);
+}
+
+template<typename Miner, typename Job, typename Solution>
+void StratumClient<Miner, Job, Solution>::setJob(Connection* c,
+		const StratumField& params, bool replace) {
+	// Pools repeat jobs, those are dropped before the header is decoded
+	if (p_current && params.count > 0
+			&& params[0].is(StratumToken::Type::String)
+			&& p_current->job.size() == params[0].size
+			&& p_current->job.compare(0, params[0].size, params[0].data,
+					params[0].size) == 0)
+		return;
+
+	// Parsed into whichever job is not current, so neither is reallocated
+	Job* workOrder = p_current == &m_jobs[0] ? &m_jobs[1] : &m_jobs[0];
+	p_miner->parseJob(m_source, params, *workOrder);
+	workOrder->connection = c->pool;
+	if (replace)
+		workOrder->clean = true;
+	p_current = workOrder;
+	p_miner->setJob(m_source, p_current);
+}
+
+template<typename Miner, typename Job, typename Solution>
+void StratumClient<Miner, Job, Solution>::switchPool(size_t pool,
+		std::function<void(const std::string& error)> done) {
+	m_io_service->post([this, pool, done]() {
+		for (std::unique_ptr<Connection>& c : m_connections) {
+			if (c->pool != pool)
+				continue;
+			if (c->state != State::Working || c->lastNotify.empty()) {
+				done("Pool " + c->name() + " has no work");
 				return;
-			} else if (p_active == &m_primary) {
-				p_active = &m_failover;
-			} else {
-				p_active = &m_primary;
 			}
-			m_retries = 0;
+			m_preferred = c->index;
+			if (c.get() != p_active)
+				activate(c.get());
+			done("");
+			return;
 		}
-	}
-
-	BOOST_LOG_CUSTOM(info) << "Reconnecting in 3 seconds...";
-	boost::asio::deadline_timer timer(*m_io_service,
-			boost::posix_time::seconds(3));
-	timer.wait();
+		done("No such pool");
+	});
 }
 
 template <typename Miner, typename Job, typename Solution>
 void StratumClient<Miner, Job, Solution>::disconnect()
 {
-    if (!m_connected) return;
-	
-    BOOST_LOG_CUSTOM(info) << "Stopping work cycle";
-    if (m_work) {
-        m_running = false;
-        m_work->join();
-        m_work.reset();
-    }
-    
-    BOOST_LOG_CUSTOM(info) << "Disconnecting";
-    m_connected = false;
+    if (m_disconnected.exchange(true)) return;
     m_running = false;
+
+    // No solver may submit once the I/O thread is gone
     if (p_miner->isMining()) {
 		BOOST_LOG_CUSTOM(info) << "Stopping miner";
         p_miner->stop();
     }
-    m_socket.close();
-    
+
+    BOOST_LOG_CUSTOM(info) << "Disconnecting";
+    m_io_service->post([this]() {
+        for (std::unique_ptr<Connection>& c : m_connections) {
+            closeSocket(c.get());
+            cancelTimer(c.get());
+            c->state = State::Stopped;
+        }
+        if (p_active)
+            speed.SetPoolActive(p_active->pool, false);
+        p_active = nullptr;
+        m_ioWork.reset();
+        m_io_service->stop();
+    });
+    if (m_ioThread && m_ioThread->get_id() != std::this_thread::get_id()) {
+        m_ioThread->join();
+        m_ioThread.reset();
+    }
+
+    // Solutions the I/O thread did not get to
+    while (m_submitQueue.size() > 0) {
+        Solution* solution = m_submitQueue.pop();
+        if (!solution)
+            continue;
+        speed.SubmitDropped();
+        p_miner->releaseSolution(solution);
+    }
 }
 
 template<typename Miner, typename Job, typename Solution>
-void StratumClient<Miner, Job, Solution>::processReponse(
-		const Object& responseObject) {
-	const Value& valError = find_value(responseObject, "error");
-	if (valError.type() == array_type) {
-		const Array& error = valError.get_array();
-		string msg;
-		if (error.size() > 0 && error[1].type() == str_type) {
-			msg = error[1].get_str();
-		} else {
-			msg = "Unknown error";
-		}
-		//LogS("%s\n", msg);
-	}
-	std::ostream os(&m_requestBuffer);
+void StratumClient<Miner, Job, Solution>::processReponse(Connection* c,
+		const StratumMessage& message, const char* line, size_t size) {
+	typedef StratumToken::Type Type;
 	std::stringstream ss;
-	const Value& valId = find_value(responseObject, "id");
-	int id = 0;
-	if (valId.type() == int_type) {
-		id = valId.get_int();
-	}
-	Value valRes;
+	int id = message.id;
 	bool accepted = false;
 	switch (id) {
 	case 0: {
-		const Value& valMethod = find_value(responseObject, "method");
-		string method = "";
-		if (valMethod.type() == str_type) {
-			method = valMethod.get_str();
-		}
-
-		if (method == "mining.notify") {
-			const Value& valParams = find_value(responseObject, "params");
-			if (valParams.type() == array_type) {
-				const Array& params = valParams.get_array();
-				Job* workOrder = p_miner->parseJob(params);
-
-				if (workOrder) {
-					if (!workOrder->clean) {
-						BOOST_LOG_CUSTOM(
-								info) << CL_CYN "Ignoring non-clean job #" << workOrder->jobId() << CL_N;
-						;
-						break;
-					}
-
-					BOOST_LOG_CUSTOM(
-							info) << CL_CYN "Received new job #" << workOrder->jobId() << CL_N;
-					//workOrder->setTarget(m_nextJobTarget);
-					//workOrder->setTarget(job->serverTarget);
-
-					if (!(p_current && *workOrder == *p_current)) {
-						//x_current.lock();
-						//if (p_worktimer)
-						//    p_worktimer->cancel();
-
-						if (p_previous) {
-							delete p_previous;
-						}
-						p_previous = p_current;
-						p_current = workOrder;
-
-						p_miner->setJob(p_current);
-						//x_current.unlock();
-						//p_worktimer = new boost::asio::deadline_timer(m_io_service, boost::posix_time::seconds(m_worktimeout));
-						//p_worktimer->async_wait(boost::bind(&StratumClient::work_timeout_handler, this, boost::asio::placeholders::error));
-					}
-				}
-			}
-		} else if (method == "mining.set_target") {
-			const Value& valParams = find_value(responseObject, "params");
-			if (valParams.type() == array_type) {
-				const Array& params = valParams.get_array();
-				m_nextJobTarget = params[0].get_str();
+		const StratumField& params = message.params;
+		if (!params.value.is(Type::Array))
+			break;
+
+		switch (message.method) {
+		case StratumMessage::Method::Notify:
+			// Solvers take a job that is not clean at their next nonce and
+			// finish the runs in progress
+			if (params.count > 0 && params[0].is(Type::String))
 				BOOST_LOG_CUSTOM(
-						info) << CL_MAG "Target set to " << m_nextJobTarget << CL_N;
+						info) << CL_CYN "Received new job #" << params[0].str()
+						<< " from " << c->name()
+						<< (params.count > 1 && params[1].is(Type::Bool) && !params[1].boolean
+								? " (not clean)" : "") << CL_N;
+
+			// Kept raw, parsed again only if this pool takes over
+			c->lastNotify.assign(line, size);
+			if (m_worktimeout > 0 && c->state == State::Working)
+				armTimer(c, m_worktimeout * 1000);
+
+			// The preferred pool takes over again as soon as it has work
+			if (c == p_active)
+				setJob(c, params, false);
+			else if (!p_active || c->index == m_preferred)
+				activate(c);
+			break;
+		case StratumMessage::Method::SetTarget:
+			if (params.count > 0 && params[0].is(Type::String)) {
+				std::string target = params[0].str();
+				if (target.size() <= 64 && IsHex(target))
+					setShareTarget(c, uint256S(target));
+				else
+					BOOST_LOG_CUSTOM(warning) << "Ignoring invalid target " << target;
 			}
-		} else if (method == "mining.set_extranonce") {
-			const Value& valParams = find_value(responseObject, "params");
-			if (valParams.type() == array_type) {
-				const Array& params = valParams.get_array();
-				p_miner->setServerNonce(params[0].get_str());
-			}
-		} else if (method == "client.reconnect") {
-			const Value& valParams = find_value(responseObject, "params");
-			if (valParams.type() == array_type) {
-				const Array& params = valParams.get_array();
-				if (params.size() > 1) {
-					p_active->host = params[0].get_str();
-					p_active->port = params[1].get_str();
+			break;
+		case StratumMessage::Method::SetExtranonce:
+			if (params.count > 0) {
+				c->extranonce = params[0].str();
+				if (c == p_active) {
+					p_miner->setServerNonce(m_source, c->extranonce);
+					m_minerExtranonce = c->extranonce;
 				}
-				// TODO: Handle wait time
-				BOOST_LOG_CUSTOM(info) << "Reconnection requested";
-				reconnect();
 			}
-		} else if(method == "mining.set_difficulty") {
-			const Value& valParams = find_value(responseObject, "params");
-			if (valParams.type() == array_type) {
-				const Array& params = valParams.get_array();
-				BOOST_LOG_CUSTOM(
-						info) << "Recv Diff: " << params[0].get_real();
-				m_currentDifficulty = params[0].get_real();
+			break;
+		case StratumMessage::Method::Reconnect:
+			if (params.count > 1) {
+				c->cred.host = params[0].str();
+				c->cred.port = params[1].str();
 			}
+			// TODO: Handle wait time
+			BOOST_LOG_CUSTOM(info) << "Reconnection requested";
+			reconnect(c);
+			break;
+		case StratumMessage::Method::SetDifficulty:
+			if (params.count > 0 && params[0].is(Type::Number)) {
+				double difficulty = params[0].toDouble();
+				BOOST_LOG_CUSTOM(info) << "Recv Diff: " << difficulty;
+				if (difficulty > 0) {
+					uint32_t words[8];
+					AionJob::diffToTarget(words, difficulty);
+					// diffToTarget writes big-endian, uint256 is the reverse
+					const unsigned char* bytes = (const unsigned char*) words;
+					uint256 target;
+					for (size_t i = 0; i < sizeof(words); i++)
+						target.begin()[i] = bytes[sizeof(words) - 1 - i];
+					setShareTarget(c, target);
+				}
+			} else if (params.count > 0 && params[0].is(Type::String)) {
+				// Pools built on the bundled stratum-pool send the target
+				// the difficulty works out to
+				std::string target = params[0].str();
+				if (target.size() <= 64 && IsHex(target))
+					setShareTarget(c, uint256S(target));
+				else
+					BOOST_LOG_CUSTOM(warning) << "Ignoring invalid difficulty " << target;
+			}
+			break;
+		default:
+			break;
 		}
 		break;
 	}
 	case 1:
-		valRes = find_value(responseObject, "result");
-		if (valRes.type() == array_type) {
-			BOOST_LOG_CUSTOM(info) << "Subscribed to stratum server";
-			const Array& result = valRes.get_array();
+		if (message.result.value.is(Type::Array)) {
 			// Ignore session ID for now.
-			p_miner->setServerNonce(result[1].get_str());
+			if (message.result.count < 2 || !message.result[1].is(Type::String)) {
+				BOOST_LOG_CUSTOM(warning) << "Invalid subscribe result from " << c->name();
+				reconnect(c);
+				break;
+			}
+			BOOST_LOG_CUSTOM(info) << "Subscribed to stratum server " << c->name();
+			c->extranonce = message.result[1].str();
 			ss << "{\"id\":2,\"method\":\"mining.authorize\",\"params\":[\""
-					<< p_active->user << "\",\"" << p_active->pass << "\"]}\n";
-			std::string sss = ss.str();
-			os << sss;
-			BOOST_LOG_CUSTOM(trace) << "Sending: " << sss;
-			write(m_socket, m_requestBuffer);
+					<< c->cred.user << "\",\"" << c->cred.pass << "\"]}\n";
+			c->state = State::Authorizing;
+			send(c, ss.str());
 		}
 		break;
 	case 2: {
-		valRes = find_value(responseObject, "result");
-		m_authorized = false;
-		if (valRes.type() == bool_type) {
-			m_authorized = valRes.get_bool();
-		}
-		if (!m_authorized) {
+		bool authorized = message.result.value.is(Type::Bool)
+				&& message.result.value.boolean;
+		if (!authorized) {
 			BOOST_LOG_CUSTOM(error) << "Worker not authorized: "
-					<< p_active->user;
-			disconnect();
+					<< c->cred.user << " on " << c->name();
+			if (c->index == 0) {
+				stopSource();
+			} else {
+				// Without a standby the primary still mines
+				closeSocket(c);
+				cancelTimer(c);
+				c->state = State::Stopped;
+			}
 			return;
 		}
-		BOOST_LOG_CUSTOM(info) << "Authorized worker " << p_active->user;
+		BOOST_LOG_CUSTOM(info) << "Authorized worker " << c->cred.user
+				<< " on " << c->name();
+
+		c->state = State::Working;
+		speed.SetPoolConnected(c->pool, true);
+		c->reconnectDelay = RECONNECT_DELAY_MIN_MS;
+		if (m_worktimeout > 0)
+			armTimer(c, m_worktimeout * 1000);
+		else
+			cancelTimer(c);
 
 		ss
-				<< "{\"id\":3,\"method\":\"mining.extranonce.subscribe\",\"params\":[]}\n";
-		std::string sss = ss.str();
-		os << sss;
-		BOOST_LOG_CUSTOM(trace) << "Sending: " << sss;
-		write(m_socket, m_requestBuffer);
+				<< "{\"id\":3,\"method\":\"mining.extranonce.subscribe\",\"params\":[]}\n"
+				<< "{\"id\":4,\"method\":\"mining.binary_submit.subscribe\",\"params\":[]}\n";
+		send(c, ss.str());
 
 		break;
 	}
 	case 3:
 		// nothing to do...
 		break;
-	default:
-		valRes = find_value(responseObject, "result");
-		if (valRes.type() == bool_type) {
-			accepted = valRes.get_bool();
+	case 4:
+		// Pools without the extension answer with an error or not at all
+		c->binarySubmit = message.result.value.is(Type::Bool)
+				&& message.result.value.boolean;
+		if (c->binarySubmit)
+			BOOST_LOG_CUSTOM(info) << "Submitting binary shares to " << c->name();
+		break;
+	default: {
+		bool stale = false;
+		uint64_t tag = 0;
+		auto pending = c->pendingShares.find(id);
+		if (pending != c->pendingShares.end()) {
+			speed.AddShareLatency(std::chrono::duration_cast<std::chrono::microseconds>(
+					std::chrono::steady_clock::now() - pending->second.written).count());
+			stale = pending->second.stale;
+			tag = pending->second.tag;
+			c->pendingShares.erase(pending);
 		}
+
+		accepted = message.result.value.is(Type::Bool)
+				&& message.result.value.boolean;
 		if (accepted) {
-			BOOST_LOG_CUSTOM(info) << CL_GRN "Accepted share #" << id << CL_N;
-			p_miner->acceptedSolution(m_stale);
+			BOOST_LOG_CUSTOM(info) << CL_GRN "Accepted " << (stale ? "stale " : "")
+					<< "share #" << id << CL_N;
+			p_miner->acceptedSolution(m_source, stale, tag);
 		} else {
-			valRes = find_value(responseObject, "error");
 			std::string reason = "unknown";
-			if (valRes.type() == array_type) {
-				const Array& params = valRes.get_array();
-				if (params.size() > 1 && params[1].type() == str_type)
-					reason = params[1].get_str();
-			}
-			BOOST_LOG_CUSTOM(warning) << CL_RED "Rejected share #" << id
-					<< CL_N " (" << reason << ")";
-			p_miner->rejectedSolution(m_stale);
+			if (message.error.count > 1 && message.error[1].is(Type::String))
+				reason = message.error[1].str();
+			BOOST_LOG_CUSTOM(warning) << CL_RED "Rejected " << (stale ? "stale " : "")
+					<< "share #" << id << CL_N " (" << reason << ")";
+			p_miner->rejectedSolution(m_source, stale, tag, reason);
 		}
 		break;
-
+	}
 	}
 }
 
 template<typename Miner, typename Job, typename Solution>
-void StratumClient<Miner, Job, Solution>::work_timeout_handler(
-		const boost::system::error_code& ec) {
-	if (!ec) {
-		//LogS("No new work received in %d seconds.\n", m_worktimeout);
-		reconnect();
+void StratumClient<Miner, Job, Solution>::send(Connection* c,
+		const std::string& request) {
+	BOOST_LOG_CUSTOM(trace) << "Sending: " << request;
+	Request queued { std::string(), 0, std::chrono::steady_clock::time_point() };
+	if (!m_spare.empty()) {
+		queued.data = std::move(m_spare.back());
+		m_spare.pop_back();
 	}
+	queued.data.assign(request);
+	c->writeQueue.push_back(std::move(queued));
+	flushWrites(c);
 }
 
 template<typename Miner, typename Job, typename Solution>
-bool StratumClient<Miner, Job, Solution>::submit(const Solution* solution,
-		const std::string& jobid, uint64_t timestamp) {
-	int id = std::atomic_fetch_add(&m_share_id, 1);
-	BOOST_LOG_CUSTOM(info) << "Submitting share #" << id << ", nonce "
-			<< solution->toString().substr(0, 64 - solution->nonce1size);
-
-	CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-	ss << solution->nonce;
-	ss << solution->solution;
-	std::string strHex = HexStr(ss.begin(), ss.end());
-
-	BOOST_LOG_CUSTOM(trace) << "nonce1size: " << solution->nonce1size;
-	BOOST_LOG_CUSTOM(trace) << "Sol size: : " << strHex.substr(64).length();
-	BOOST_LOG_CUSTOM(trace) << "vector size: : " << solution->solution.size();
-	BOOST_LOG_CUSTOM(trace) << "timestamp: : " << timestamp;
-
-	//char c_timestamp[16];
-
-	//  timestamp to BE.
-	uint64_t bets = bswap_64(timestamp);
-
-	BOOST_LOG_CUSTOM(trace) << "timestamp_BE: : " << bets;
-
-	// // transform to 16 bytes hex.
-	// sprintf(c_timestamp, "%lx", bets);
-
-	// //printf("timestamp: %s \n", c_timestamp);
-	// BOOST_LOG_CUSTOM(trace) << "c_timestamp: : " << c_timestamp;
+void StratumClient<Miner, Job, Solution>::flushWrites(Connection* c) {
+	if (!c->writing.empty() || c->writeQueue.empty())
+		return;
+
+	// Everything queued goes out in one gathered write
+	c->writeBuffers.clear();
+	while (!c->writeQueue.empty()) {
+		c->writing.push_back(std::move(c->writeQueue.front()));
+		c->writeQueue.pop_front();
+		c->writeBuffers.push_back(boost::asio::buffer(c->writing.back().data));
+	}
+	boost::asio::async_write(c->socket, c->writeBuffers,
+			boost::bind(&StratumClient::onWritten, this, c, c->generation,
+					boost::asio::placeholders::error));
+}
 
-	std::stringstream c_timestamp;
-	c_timestamp << std::setfill('0') << std::setw(sizeof(uint64_t) * 2) << std::hex << bets;
+template<typename Miner, typename Job, typename Solution>
+void StratumClient<Miner, Job, Solution>::onWritten(Connection* c,
+		unsigned int generation, const boost::system::error_code& ec) {
+	bool written = !ec && generation == c->generation;
+	auto now = std::chrono::steady_clock::now();
+	for (Request& request : c->writing) {
+		if (request.id) {
+			if (written) {
+				speed.SubmitSent(std::chrono::duration_cast<std::chrono::microseconds>(
+						now - request.queued).count());
+				auto pending = c->pendingShares.find(request.id);
+				if (pending != c->pendingShares.end())
+					pending->second.written = now;
+			} else
+				speed.SubmitDropped();
+		}
+		m_spare.push_back(std::move(request.data));
+	}
+	c->writing.clear();
+	BOOST_LOG_CUSTOM(trace) << "Write Completed";
 
-	BOOST_LOG_CUSTOM(trace) << "timestamp bets : : " << c_timestamp.str();
+	if (generation != c->generation) {
+		// Requests queued for a newer connection waited for this batch
+		flushWrites(c);
+		return;
+	}
+	if (ec) {
+		BOOST_LOG_CUSTOM(warning) << "Write to " << c->name() << " failed: "
+				<< ec.message();
+		reconnect(c);
+		return;
+	}
+	flushWrites(c);
+}
 
-	std::stringstream stream;
-	stream << "{\"id\":" << id
-			<< ",\"method\":\"mining.submit\",\"params\":[\"";
-	stream << p_active->user;
-	stream << "\",\"" << jobid;
+template<typename Miner, typename Job, typename Solution>
+bool StratumClient<Miner, Job, Solution>::submit(Solution* solution) {
+	solution->queued = std::chrono::steady_clock::now();
+	speed.SubmitQueued();
+	m_submitQueue.push(solution);
+	// One flush is posted at a time, it takes every solution queued by then
+	if (!m_submitPosted.exchange(true))
+		m_io_service->post(boost::bind(&StratumClient::flushSubmits, this));
+	return true;
+}
 
+template<typename Miner, typename Job, typename Solution>
+int StratumClient<Miner, Job, Solution>::formatSubmit(Connection* c,
+		const Solution* solution, std::string& json) {
+	int id = c->shareId++;
+	BOOST_LOG_CUSTOM(info) << "Submitting share #" << id << " to " << c->name()
+			<< ", nonce " << solution->toString().substr(0, 64 - solution->nonce1size);
 
-	//stream << "\",\"" << solution->time;
+	BOOST_LOG_CUSTOM(trace) << "nonce1size: " << solution->nonce1size;
+	BOOST_LOG_CUSTOM(trace) << "timestamp: : " << solution->timestamp;
+
+	//  timestamp to BE, sent as 16 hex digits.
+	uint64_t bets = bswap_64(solution->timestamp);
+	if (c->binarySubmit && formatBinarySubmit(id, solution, bets, json))
+		return id;
+	char c_timestamp[sizeof(uint64_t) * 2 + 1];
+	snprintf(c_timestamp, sizeof(c_timestamp), "%016" PRIx64, bets);
+
+	json.clear();
+	json += "{\"id\":";
+	json += std::to_string(id);
+	json += ",\"method\":\"mining.submit\",\"params\":[\"";
+	json += c->cred.user;
+	json += "\",\"";
+	json += solution->jobId;
 	// replace nTime in stratum with updated timestamp in hex( 16 bytes ) format.
-	stream << "\",\"" << c_timestamp.str();
-
-	stream << "\",\""
-			<< strHex.substr(solution->nonce1size, 64 - solution->nonce1size);
-	stream << "\",\"" << strHex.substr(64);
-	//stream << "\",\"" << timestamp;
-	stream << "\"]}\n";
-	std::string json = stream.str();
-	std::ostream os(&m_requestBuffer);
-	os << json;
+	json += "\",\"";
+	json += c_timestamp;
+	json += "\",\"";
+	solution->appendNonce2Hex(json);
+	json += "\",\"";
+	solution->appendSolutionHex(json);
+	json += "\"]}\n";
 	BOOST_LOG_CUSTOM(trace) << "Sending: " << json;
-	write(m_socket, m_requestBuffer);
-	BOOST_LOG_CUSTOM(trace) << "Write Completed";
+	return id;
+}
+
+template<typename Miner, typename Job, typename Solution>
+bool StratumClient<Miner, Job, Solution>::formatBinarySubmit(int id,
+		const Solution* solution, uint64_t bets, std::string& frame) {
+	// Marker, payload length, then the request id, the job id, nTime, the
+	// nonce past nonce1 and the solution without its size prefix. Integers
+	// are little-endian, nTime holds the bytes of its hex form.
+	size_t nonce2size = 32 - solution->nonce1size / 2;
+	size_t length = 4 + 1 + solution->jobId.size() + 8 + 1 + nonce2size
+			+ sizeof(solution->solution);
+	// Both are single length fields, longer ones go out as JSON
+	if (solution->jobId.size() > UINT8_MAX || length > UINT16_MAX)
+		return false;
+
+	frame.clear();
+	frame += (char) BINARY_SUBMIT_MARKER;
+	frame += (char) (length & 0xFF);
+	frame += (char) (length >> 8);
+	for (int i = 0; i < 4; i++)
+		frame += (char) ((id >> (8 * i)) & 0xFF);
+	frame += (char) solution->jobId.size();
+	frame += solution->jobId;
+	for (int i = 7; i >= 0; i--)
+		frame += (char) ((bets >> (8 * i)) & 0xFF);
+	frame += (char) nonce2size;
+	frame.append((const char*) solution->nonce.begin() + 32 - nonce2size, nonce2size);
+	frame.append((const char*) solution->solution, sizeof(solution->solution));
+	BOOST_LOG_CUSTOM(trace) << "Sending " << frame.size() << " byte binary submit";
 	return true;
 }
 
+template<typename Miner, typename Job, typename Solution>
+void StratumClient<Miner, Job, Solution>::flushSubmits() {
+	// Cleared before draining, so a push after the last check posts again
+	m_submitPosted.store(false);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	size_t dropped = 0;
+	auto now = std::chrono::steady_clock::now();
+	while (m_submitQueue.size() > 0) {
+		Solution* solution = m_submitQueue.pop();
+		if (!solution) {
+			std::this_thread::yield(); // a push is half way through
+			continue;
+		}
+		// Shares go to the pool their job came from
+		Connection* c = nullptr;
+		for (std::unique_ptr<Connection>& connection : m_connections)
+			if (connection->pool == solution->connection)
+				c = connection.get();
+		if (!c || c->state != State::Working) {
+			dropped++;
+			speed.SubmitDropped();
+		} else {
+			if (c->pendingShares.size() >= MAX_PENDING_SHARES)
+				c->pendingShares.clear();
+			Request request { std::string(), 0, solution->queued };
+			if (!m_spare.empty()) {
+				request.data = std::move(m_spare.back());
+				m_spare.pop_back();
+			}
+			request.id = formatSubmit(c, solution, request.data);
+			// Registered now, the answer is matched even if it beats onWritten
+			c->pendingShares[request.id] = PendingShare { now, solution->stale, solution->tag };
+			c->writeQueue.push_back(std::move(request));
+		}
+		p_miner->releaseSolution(solution);
+	}
+	if (dropped)
+		BOOST_LOG_CUSTOM(warning) << "Not connected, dropping " << dropped
+				<< (dropped == 1 ? " share" : " shares");
+	for (std::unique_ptr<Connection>& c : m_connections)
+		flushWrites(c.get());
+}
+
 // create StratumClient class
 template class StratumClient<AionMiner, AionJob, EquihashSolution> ;
+template class StratumClient<StratumProxy, ProxyJob, EquihashSolution> ;
@@ -6,6 +6,8 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "libstratum/AionStratum.h"
+#include "libstratum/MpscQueue.h"
+#include "libstratum/StratumProxy.h"
 
 
 #include <iostream>
@@ -15,7 +17,11 @@
 #include <mutex>
 #include <thread>
 #include <atomic>
+#include <chrono>
 #include <cstdio>
+#include <deque>
+#include <functional>
+#include <unordered_map>
 
 #include "json/json_spirit_value.h"
 
@@ -96,6 +102,23 @@ typedef struct {
         string pass;
 } cred_t;
 
+/**
+ * Stratum client driven by asynchronous handlers on one I/O thread, which
+ * runs the io_service it is given. For every pool, resolve, connect, subscribe,
+ * authorize, extranonce subscribe and the read loop are chained handlers,
+ * writes go through a queue with at most one async_write in flight, and a
+ * timer bounds each step. Solver threads only push to a lock-free queue.
+ * Pools that accept mining.binary_submit.subscribe get shares as
+ * length-prefixed frames with the raw solution instead of JSON lines.
+ *
+ * A failover pool is kept subscribed and authorized as a hot standby. Its
+ * jobs are held unparsed, so when the active pool fails the standby's last
+ * job goes to the solvers at once, without pausing them. The primary takes
+ * over again once it is back and sends a job.
+ *
+ * Each client feeds one job source of the miner, several clients with
+ * their own io_service let one miner split its solvers between pools.
+ */
 template <typename Miner, typename Job, typename Solution>
 class StratumClient
 {
@@ -103,65 +126,173 @@ public:
 	StratumClient(std::shared_ptr<boost::asio::io_service> io_s, Miner * m,
                   string const & host, string const & port,
                   string const & user, string const & pass,
-                  int const & retries, int const & worktimeout);
-    ~StratumClient() { }
+                  int const & worktimeout,
+                  size_t source = 0);
+    ~StratumClient();
 
+    // Adds the standby pool, at most one
     void setFailover(string const & host, string const & port);
     void setFailover(string const & host, string const & port,
                      string const & user, string const & pass);
 
     bool isRunning() { return m_running; }
-    bool isConnected() { return m_connected && m_authorized; }
     bool current() { return p_current; }
-    bool submit(const Solution* solution, const std::string& jobid, uint64_t timestamp);
-    void reconnect();
+    // Queues the solution for the I/O thread, which releases it to the
+    // miner once formatted
+    bool submit(Solution* solution);
+    // Stops the miner and the I/O thread, from any thread
     void disconnect();
+    // Mines on the connection with speed pool index pool from now on and
+    // prefers it over the primary, from any thread. done is called on the
+    // I/O thread with an error, empty if the switch was made.
+    void switchPool(size_t pool, std::function<void(const std::string& error)> done);
 
 private:
-    void startWorking();
-    void workLoop();
-    void connect();
-
-    void work_timeout_handler(const boost::system::error_code& ec);
-
-    void processReponse(const Object& responseObject);
-
-    cred_t * p_active;
-    cred_t m_primary;
-    cred_t m_failover;
+    enum class State {
+        Idle,
+        Waiting,     // reconnect delay
+        Resolving,
+        Connecting,
+        Subscribing, // mining.subscribe sent
+        Authorizing, // mining.authorize sent
+        Working,     // authorized, extranonce subscribed, receiving jobs
+        Stopped
+    };
+
+    // A request waiting to be written, id is the share id of submits
+    struct Request
+    {
+        std::string data;
+        int id;
+        std::chrono::steady_clock::time_point queued;
+    };
+
+    // Submitted shares by request id, until the pool answers
+    struct PendingShare
+    {
+        std::chrono::steady_clock::time_point written;
+        bool stale;
+        uint64_t tag; // the solution's, handed back with the answer
+    };
+
+    // One pool and its socket, only touched by the I/O thread
+    struct Connection
+    {
+        size_t index; // 0 is the primary pool
+        size_t pool;  // its Speed pool stats, jobs carry it as their connection
+        cred_t cred;
+        State state;
+        tcp::resolver resolver;
+        tcp::socket socket;
+        // Bumped when the socket is closed, handlers of older connections
+        // compare it against their own and return
+        unsigned int generation;
+
+        boost::asio::streambuf responseBuffer;
+        // Requests not yet written, and the batch being written
+        std::deque<Request> writeQueue;
+        std::vector<Request> writing;
+        std::vector<boost::asio::const_buffer> writeBuffers;
+        std::unordered_map<int, PendingShare> pendingShares;
+        int shareId;
+        bool binarySubmit; // the pool accepted mining.binary_submit.subscribe
+
+        // Step timeout, work timeout or reconnect delay, depending on state
+        boost::asio::deadline_timer worktimer;
+        unsigned int timerSerial;
+        int reconnectDelay; // milliseconds, grows while connecting fails
+
+        // Kept so the pool can take over the solvers without a round trip
+        std::string extranonce;
+        std::string lastNotify; // the whole line
+        // Latest mining.set_target or mining.set_difficulty, whichever
+        // came last, solutions above it are not submitted
+        bool hasShareTarget;
+        uint256 shareTarget;
+
+        Connection(boost::asio::io_service& io_service, size_t index, const cred_t& cred);
+        std::string name() const { return cred.host + ":" + cred.port; }
+    };
 
-    bool m_authorized;
-    bool m_connected;
-    bool m_running = true;
-
-    int    m_retries = 0;
-    int    m_maxRetries;
+    void startWorking();
+    void addConnection(const cred_t& cred);
+    void resolve(Connection* c);
+    void onResolved(Connection* c, unsigned int generation,
+                    const boost::system::error_code& ec,
+                    tcp::resolver::iterator endpoints);
+    void onConnected(Connection* c, unsigned int generation,
+                     const boost::system::error_code& ec);
+    void readResponse(Connection* c);
+    void onRead(Connection* c, unsigned int generation,
+                const boost::system::error_code& ec, size_t length);
+    void send(Connection* c, const std::string& request);
+    void flushWrites(Connection* c);
+    void onWritten(Connection* c, unsigned int generation,
+                   const boost::system::error_code& ec);
+    void flushSubmits();
+    void armTimer(Connection* c, int milliseconds);
+    void cancelTimer(Connection* c);
+    void onTimer(Connection* c, unsigned int serial,
+                 const boost::system::error_code& ec);
+    void closeSocket(Connection* c);
+    // Closes the connection and connects again after a delay
+    void reconnect(Connection* c);
+    // Gives up on the pools for good but leaves the miner to the other
+    // clients, only this client's source runs dry
+    void stopSource();
+    // Makes the pool the source of the miner's jobs, with its last job
+    void activate(Connection* c);
+    // A replacing job cancels running solvers whatever its clean flag,
+    // for jobs of another pool
+    void setJob(Connection* c, const StratumField& params, bool replace);
+    void setShareTarget(Connection* c, const uint256& target);
+    // A JSON line, or a binary frame if the pool took the extension
+    int formatSubmit(Connection* c, const Solution* solution, std::string& json);
+    // False if the job id or the payload is too long for the frame
+    bool formatBinarySubmit(int id, const Solution* solution, uint64_t bets,
+                            std::string& frame);
+
+    // line is the raw message, for the lastNotify copy
+    void processReponse(Connection* c, const StratumMessage& message,
+                        const char* line, size_t size);
+
+    // Cleared by stopSource and disconnect, only disconnect tears down the
+    // I/O thread and the miner
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_disconnected;
     int m_worktimeout = 60;
 
-    string m_response;
+    // Reused for every line read
+    StratumMessage m_message;
 
     Miner * p_miner;
-    std::mutex x_current;
+    // Miner job source this client sets jobs on
+    size_t m_source;
+    // Jobs are parsed into the one of these that is not current
+    Job m_jobs[2];
     Job * p_current;
-    Job * p_previous;
-
-    bool m_stale = false;
-
-    std::unique_ptr<std::thread> m_work;
 
     std::shared_ptr<boost::asio::io_service> m_io_service;
-    tcp::socket m_socket;
-
-    boost::asio::streambuf m_requestBuffer;
-    boost::asio::streambuf m_responseBuffer;
-
-    boost::asio::deadline_timer * p_worktimer;
-
-    string m_nextJobTarget;
-
-    double m_currentDifficulty;
-
-	std::atomic_int m_share_id;
+    std::unique_ptr<boost::asio::io_service::work> m_ioWork;
+    std::unique_ptr<std::thread> m_ioThread;
+
+    std::vector<std::unique_ptr<Connection>> m_connections;
+    // Source of the miner's jobs, null while no pool is working
+    Connection * p_active;
+    // Connection that takes over whenever it has work, the primary unless
+    // switched through the API
+    size_t m_preferred;
+    // Extranonce the miner was last given
+    std::string m_minerExtranonce;
+    // When the active pool was lost, for the switchover time
+    std::chrono::steady_clock::time_point m_lostAt;
+    bool m_lost;
+
+    // Solver threads queue solutions, the I/O thread formats them
+    MpscQueue<Solution> m_submitQueue;
+    std::atomic<bool> m_submitPosted;
+    // Request strings kept for reuse, so they keep their capacity
+    std::vector<std::string> m_spare;
 
 	unsigned char o_index;
 };
@@ -172,3 +303,6 @@ private:
 
 // AionStratumClient
 typedef StratumClient<AionMiner, AionJob, EquihashSolution> AionStratumClient;
+
+// ProxyStratumClient, the upstream session of --proxy
+typedef StratumClient<StratumProxy, ProxyJob, EquihashSolution> ProxyStratumClient;
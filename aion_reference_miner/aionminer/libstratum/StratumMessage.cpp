@@ -0,0 +1,300 @@
+// Copyright (c) 2018 Aion Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "StratumMessage.h"
+
+#include "utilstrencodings.h"
+
+#include <cstdlib>
+#include <cstring>
+
+bool StratumToken::equals(const char* s) const {
+	size_t length = strlen(s);
+	return type == Type::String && !escaped && size == length
+			&& memcmp(data, s, length) == 0;
+}
+
+static void AppendUtf8(std::string& out, unsigned int c) {
+	if (c < 0x80) {
+		out += (char) c;
+	} else if (c < 0x800) {
+		out += (char) (0xC0 | (c >> 6));
+		out += (char) (0x80 | (c & 0x3F));
+	} else {
+		out += (char) (0xE0 | (c >> 12));
+		out += (char) (0x80 | ((c >> 6) & 0x3F));
+		out += (char) (0x80 | (c & 0x3F));
+	}
+}
+
+std::string StratumToken::str() const {
+	if (type != Type::String)
+		return std::string(data ? data : "", data ? size : 0);
+	if (!escaped)
+		return std::string(data, size);
+
+	std::string out;
+	out.reserve(size);
+	const char* end = data + size;
+	for (const char* p = data; p < end; ++p) {
+		if (*p != '\\' || p + 1 == end) {
+			out += *p;
+			continue;
+		}
+		switch (*++p) {
+		case 'b': out += '\b'; break;
+		case 'f': out += '\f'; break;
+		case 'n': out += '\n'; break;
+		case 'r': out += '\r'; break;
+		case 't': out += '\t'; break;
+		case 'u': {
+			unsigned int c = 0;
+			int digits = 0;
+			for (; digits < 4 && p + 1 < end && HexDigit(p[1]) >= 0; ++digits)
+				c = (c << 4) | HexDigit(*++p);
+			AppendUtf8(out, c);
+			break;
+		}
+		default: out += *p; break; // quote, backslash and slash
+		}
+	}
+	return out;
+}
+
+int StratumToken::toInt() const {
+	if (type != Type::Number)
+		return 0;
+	// The line need not be terminated, so do not hand it to strtol
+	const char* p = data;
+	const char* end = data + size;
+	bool negative = p < end && *p == '-';
+	if (negative)
+		++p;
+	int value = 0;
+	for (; p < end && *p >= '0' && *p <= '9'; ++p)
+		value = value * 10 + (*p - '0');
+	return negative ? -value : value;
+}
+
+double StratumToken::toDouble() const {
+	if (type != Type::Number)
+		return 0;
+	char number[64];
+	size_t length = size < sizeof(number) - 1 ? size : sizeof(number) - 1;
+	memcpy(number, data, length);
+	number[length] = '\0';
+	return strtod(number, nullptr);
+}
+
+bool StratumToken::decodeHex(unsigned char* out) const {
+	if (type != Type::String || size % 2)
+		return false;
+	for (size_t i = 0; i < size; i += 2) {
+		signed char high = HexDigit(data[i]);
+		signed char low = HexDigit(data[i + 1]);
+		if (high < 0 || low < 0)
+			return false;
+		*out++ = (unsigned char) ((high << 4) | low);
+	}
+	return true;
+}
+
+void StratumMessage::clear() {
+	id = 0;
+	method = Method::None;
+	methodName.type = StratumToken::Type::None;
+	params.value.type = StratumToken::Type::None;
+	params.count = 0;
+	result.value.type = StratumToken::Type::None;
+	result.count = 0;
+	error.value.type = StratumToken::Type::None;
+	error.count = 0;
+}
+
+namespace {
+
+// Recursive descent over one line, tokens are spans of it
+class Parser
+{
+	const char* p;
+	const char* end;
+
+	void skipSpace() {
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+			++p;
+	}
+
+	bool literal(StratumToken& token, const char* word, size_t length) {
+		if ((size_t) (end - p) < length || memcmp(p, word, length) != 0)
+			return false;
+		token.size = length;
+		p += length;
+		return true;
+	}
+
+public:
+	Parser(const char* data, size_t size) : p(data), end(data + size) {
+	}
+
+	bool consume(char c) {
+		skipSpace();
+		if (p == end || *p != c)
+			return false;
+		++p;
+		return true;
+	}
+
+	bool atEnd() {
+		skipSpace();
+		return p == end;
+	}
+
+	bool value(StratumToken& token, int depth) {
+		skipSpace();
+		if (p == end)
+			return false;
+		token.data = p;
+		token.boolean = false;
+		token.escaped = false;
+		switch (*p) {
+		case '"':
+			token.type = StratumToken::Type::String;
+			token.data = ++p;
+			while (p < end && *p != '"') {
+				if (*p == '\\') {
+					token.escaped = true;
+					++p;
+				}
+				++p;
+			}
+			if (p >= end)
+				return false;
+			token.size = p++ - token.data;
+			return true;
+		case '[':
+		case '{': {
+			bool object = *p == '{';
+			char close = object ? '}' : ']';
+			token.type = object ? StratumToken::Type::Object : StratumToken::Type::Array;
+			if (depth >= STRATUM_MAX_DEPTH)
+				return false;
+			++p;
+			StratumToken child;
+			if (!consume(close)) {
+				do {
+					if (object && !(value(child, depth + 1)
+							&& child.is(StratumToken::Type::String) && consume(':')))
+						return false;
+					if (!value(child, depth + 1))
+						return false;
+				} while (consume(','));
+				if (!consume(close))
+					return false;
+			}
+			token.size = p - token.data;
+			return true;
+		}
+		case 't':
+			token.type = StratumToken::Type::Bool;
+			token.boolean = true;
+			return literal(token, "true", 4);
+		case 'f':
+			token.type = StratumToken::Type::Bool;
+			return literal(token, "false", 5);
+		case 'n':
+			token.type = StratumToken::Type::Null;
+			return literal(token, "null", 4);
+		default:
+			token.type = StratumToken::Type::Number;
+			while (p < end && ((*p >= '0' && *p <= '9') || *p == '-' || *p == '+'
+					|| *p == '.' || *p == 'e' || *p == 'E'))
+				++p;
+			token.size = p - token.data;
+			return token.size > 0;
+		}
+	}
+
+	// A member value, keeping the elements if it is an array
+	bool field(StratumField& field) {
+		field.count = 0;
+		skipSpace();
+		if (p == end || *p != '[')
+			return value(field.value, 1);
+
+		field.value.type = StratumToken::Type::Array;
+		field.value.data = p++;
+		field.value.boolean = false;
+		field.value.escaped = false;
+		if (!consume(']')) {
+			StratumToken skipped;
+			do {
+				StratumToken& item = field.count < STRATUM_MAX_ITEMS ?
+						field.items[field.count++] : skipped;
+				if (!value(item, 2))
+					return false;
+			} while (consume(','));
+			if (!consume(']'))
+				return false;
+		}
+		field.value.size = p - field.value.data;
+		return true;
+	}
+};
+
+}
+
+bool ParseStratumMessage(const char* data, size_t size, StratumMessage& message) {
+	message.clear();
+	Parser parser(data, size);
+	if (!parser.consume('{'))
+		return false;
+
+	if (!parser.consume('}')) {
+		StratumToken key, skipped;
+		do {
+			if (!parser.value(key, 1) || !key.is(StratumToken::Type::String)
+					|| !parser.consume(':'))
+				return false;
+			bool parsed;
+			if (key.equals("id")) {
+				parsed = parser.value(skipped, 1);
+				if (parsed)
+					message.id = skipped.toInt();
+			} else if (key.equals("method")) {
+				parsed = parser.value(message.methodName, 1);
+			} else if (key.equals("params")) {
+				parsed = parser.field(message.params);
+			} else if (key.equals("result")) {
+				parsed = parser.field(message.result);
+			} else if (key.equals("error")) {
+				parsed = parser.field(message.error);
+			} else {
+				parsed = parser.value(skipped, 1);
+			}
+			if (!parsed)
+				return false;
+		} while (parser.consume(','));
+		if (!parser.consume('}'))
+			return false;
+	}
+	if (!parser.atEnd())
+		return false;
+
+	const StratumToken& name = message.methodName;
+	if (!name.is(StratumToken::Type::String))
+		message.method = StratumMessage::Method::None;
+	else if (name.equals("mining.notify"))
+		message.method = StratumMessage::Method::Notify;
+	else if (name.equals("mining.set_target"))
+		message.method = StratumMessage::Method::SetTarget;
+	else if (name.equals("mining.set_difficulty"))
+		message.method = StratumMessage::Method::SetDifficulty;
+	else if (name.equals("mining.set_extranonce"))
+		message.method = StratumMessage::Method::SetExtranonce;
+	else if (name.equals("client.reconnect"))
+		message.method = StratumMessage::Method::Reconnect;
+	else
+		message.method = StratumMessage::Method::Other;
+	return true;
+}
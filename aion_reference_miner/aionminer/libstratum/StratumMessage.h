@@ -0,0 +1,79 @@
+#pragma once
+// Copyright (c) 2018 Aion Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <cstddef>
+#include <string>
+
+// Elements kept of params, result and error, later ones are skipped
+#define STRATUM_MAX_ITEMS 16
+// Nesting below this depth is rejected
+#define STRATUM_MAX_DEPTH 32
+
+/**
+ * A JSON value as it appears in the line, not copied. Strings point past
+ * the opening quote, arrays and objects span their brackets.
+ */
+struct StratumToken
+{
+	enum class Type { None, Null, Bool, Number, String, Array, Object };
+
+	Type type;
+	const char* data;
+	size_t size;
+	bool boolean;
+	bool escaped; // string holds escapes, only str() decodes them
+
+	bool is(Type t) const { return type == t; }
+	bool equals(const char* s) const;
+	std::string str() const;
+	int toInt() const;
+	double toDouble() const;
+	// Writes size / 2 bytes of a hex string to out, false if not hex
+	bool decodeHex(unsigned char* out) const;
+};
+
+// A member of the message and, if it is an array, its elements
+struct StratumField
+{
+	StratumToken value;
+	StratumToken items[STRATUM_MAX_ITEMS];
+	size_t count;
+
+	// Slots past count hold tokens of earlier messages, they read as None
+	const StratumToken& operator[](size_t i) const {
+		static const StratumToken none = { StratumToken::Type::None, nullptr, 0, false, false };
+		return i < count ? items[i] : none;
+	}
+};
+
+/**
+ * One stratum line, parsed in place. The tokens point into the line, which
+ * must outlive the message. Only the members stratum uses are kept.
+ */
+struct StratumMessage
+{
+	enum class Method {
+		None, // a response
+		Notify,
+		SetTarget,
+		SetDifficulty,
+		SetExtranonce,
+		Reconnect,
+		Other
+	};
+
+	int id; // 0 when null or absent, as for notifications
+	Method method;
+	StratumToken methodName;
+	StratumField params;
+	StratumField result;
+	StratumField error;
+
+	void clear();
+};
+
+// Parses a line holding one JSON object, without the newline. Returns
+// false if it is not one, message is then undefined.
+bool ParseStratumMessage(const char* data, size_t size, StratumMessage& message);
@@ -0,0 +1,425 @@
+// Copyright (c) 2018 Aion Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "StratumProxy.h"
+#include "version.h"
+#include "utilstrencodings.h"
+#include "speed.hpp"
+
+#include <boost/bind.hpp>
+#include <boost/log/trivial.hpp>
+
+#include <algorithm>
+#include <byteswap.h>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#define BOOST_LOG_CUSTOM(sev) BOOST_LOG_TRIVIAL(sev) << "proxy | "
+
+using boost::asio::ip::tcp;
+
+// Escapes a string for a JSON value
+static std::string JsonEscape(const std::string& s) {
+	std::string out;
+	out.reserve(s.size());
+	for (char c : s) {
+		if (c == '"' || c == '\\')
+			out += '\\';
+		if ((unsigned char) c >= 0x20)
+			out += c;
+	}
+	return out;
+}
+
+StratumProxy::Session::Session(boost::asio::io_service& io_service,
+		uint32_t id, uint16_t prefix) :
+		id(id), prefix(prefix), socket(io_service), readBuffer(PROXY_MAX_LINE),
+		subscribeId(0), subscribed(false), authorized(false),
+		extranonceSubscribed(false) {
+}
+
+StratumProxy::StratumProxy(std::shared_ptr<boost::asio::io_service> io_service,
+		const std::string& host, const std::string& port) :
+		m_io_service(io_service), m_acceptor(*io_service), m_isActive(false),
+		m_sessionCount(0), m_nextSession(1), m_nextPrefix(0), m_connection(0),
+		m_solutionPool(PROXY_MAX_SOLUTIONS) {
+	try {
+		tcp::resolver resolver(*io_service);
+		tcp::endpoint endpoint = *resolver.resolve(tcp::resolver::query(host, port));
+		m_acceptor.open(endpoint.protocol());
+		m_acceptor.set_option(tcp::acceptor::reuse_address(true));
+		m_acceptor.bind(endpoint);
+		m_acceptor.listen();
+	} catch (const boost::system::system_error& e) {
+		throw std::runtime_error("Proxy cannot listen on " + host + ":" + port
+				+ ", " + e.what());
+	}
+	BOOST_LOG_CUSTOM(info) << "Listening for miners on " << host << ":" << port;
+}
+
+StratumProxy::~StratumProxy() {
+	m_sessions.clear();
+}
+
+std::string StratumProxy::userAgent() {
+	return "nheqminer-proxy/" STANDALONE_MINER_VERSION;
+}
+
+void StratumProxy::start() {
+	m_isActive = true;
+	speed.Reset();
+	accept();
+}
+
+void StratumProxy::stop() {
+	if (!m_isActive.exchange(false))
+		return;
+	m_io_service->post([this]() {
+		boost::system::error_code ignored;
+		m_acceptor.close(ignored);
+		while (!m_sessions.empty())
+			close(m_sessions.begin()->second);
+	});
+}
+
+void StratumProxy::accept() {
+	if (!m_isActive)
+		return;
+	if (m_freePrefixes.empty() && m_nextPrefix >> (8 * PROXY_PREFIX_BYTES)) {
+		// Every prefix is taken, accepting resumes when a miner leaves
+		BOOST_LOG_CUSTOM(warning) << "Serving " << m_sessions.size()
+				<< " miners, no more are accepted";
+		return;
+	}
+	uint16_t prefix;
+	if (!m_freePrefixes.empty()) {
+		prefix = m_freePrefixes.front();
+		m_freePrefixes.pop_front();
+	} else
+		prefix = m_nextPrefix++;
+	SessionPtr session = std::make_shared<Session>(*m_io_service, m_nextSession++, prefix);
+	m_acceptor.async_accept(session->socket,
+			boost::bind(&StratumProxy::onAccepted, this, session,
+					boost::asio::placeholders::error));
+}
+
+void StratumProxy::onAccepted(SessionPtr session,
+		const boost::system::error_code& ec) {
+	if (ec) {
+		// No miner ever had it
+		m_freePrefixes.push_front(session->prefix);
+		if (ec != boost::asio::error::operation_aborted) {
+			BOOST_LOG_CUSTOM(warning) << "Accepting a miner failed, " << ec.message();
+			accept();
+		}
+		return;
+	}
+	boost::system::error_code ignored;
+	session->socket.set_option(tcp::no_delay(true), ignored);
+	tcp::endpoint remote = session->socket.remote_endpoint(ignored);
+	BOOST_LOG_CUSTOM(info) << "Miner #" << session->id << " connected from "
+			<< remote.address().to_string();
+	m_sessions[session->id] = session;
+	m_sessionCount = m_sessions.size();
+	read(session);
+	accept();
+}
+
+void StratumProxy::read(SessionPtr session) {
+	boost::asio::async_read_until(session->socket, session->readBuffer, "\n",
+			boost::bind(&StratumProxy::onRead, this, session,
+					boost::asio::placeholders::error,
+					boost::asio::placeholders::bytes_transferred));
+}
+
+void StratumProxy::onRead(SessionPtr session,
+		const boost::system::error_code& ec, size_t length) {
+	if (!session->socket.is_open())
+		return;
+	if (ec) {
+		if (ec == boost::asio::error::not_found)
+			BOOST_LOG_CUSTOM(warning) << "Miner #" << session->id
+					<< " sent a line over " << PROXY_MAX_LINE << " bytes";
+		close(session);
+		return;
+	}
+
+	// Parsed in place, as the client does
+	const char* line = boost::asio::buffer_cast<const char*>(
+			session->readBuffer.data());
+	StratumMessage message;
+	if (!ParseStratumMessage(line, length - 1, message)) {
+		BOOST_LOG_CUSTOM(warning) << "Malformed message from miner #" << session->id;
+		close(session);
+		return;
+	}
+	process(session, message);
+
+	if (session->socket.is_open()) {
+		session->readBuffer.consume(length);
+		read(session);
+	}
+}
+
+void StratumProxy::process(const SessionPtr& session,
+		const StratumMessage& message) {
+	const StratumToken& method = message.methodName;
+	if (method.equals("mining.subscribe")) {
+		session->subscribeId = message.id;
+		if (!m_extranonce.empty())
+			answerSubscribe(session);
+	} else if (method.equals("mining.authorize")) {
+		if (message.params.count > 0)
+			session->worker = message.params[0].str();
+		session->authorized = true;
+		reply(session, message.id, "true");
+		sendJob(session);
+	} else if (method.equals("mining.extranonce.subscribe")) {
+		session->extranonceSubscribed = true;
+		reply(session, message.id, "true");
+	} else if (method.equals("mining.submit")) {
+		submit(session, message);
+	} else if (message.method != StratumMessage::Method::None) {
+		// Binary submits included, the link to the miners is local
+		replyError(session, message.id, 20, "Not supported.");
+	}
+}
+
+void StratumProxy::submit(const SessionPtr& session,
+		const StratumMessage& message) {
+	typedef StratumToken::Type Type;
+	if (!session->authorized) {
+		replyError(session, message.id, 24, "unauthorized worker");
+		return;
+	}
+	if (!session->subscribed) {
+		replyError(session, message.id, 25, "not subscribed");
+		return;
+	}
+
+	// Worker, job id, nTime, nonce2 and the solution with its size prefix
+	const StratumField& params = message.params;
+	size_t nonce1Bytes = m_extranonceBytes.size() + PROXY_PREFIX_BYTES;
+	if (params.count != 5 || !params[1].is(Type::String)
+			|| !params[2].is(Type::String) || params[2].size != 16
+			|| !params[3].is(Type::String)
+			|| nonce1Bytes + params[3].size / 2 != 32
+			|| !params[4].is(Type::String)
+			|| params[4].size != 6 + 2 * EQUIVERIFY_SOLUTION_BYTES) {
+		replyError(session, message.id, 20, "Invalid submit params");
+		return;
+	}
+
+	EquihashSolution* solution = m_solutionPool.acquire();
+	if (!solution) {
+		replyError(session, message.id, 20, "Proxy busy");
+		return;
+	}
+	unsigned char* nonce = solution->nonce.begin();
+	memcpy(nonce, m_extranonceBytes.data(), m_extranonceBytes.size());
+	for (int i = 0; i < PROXY_PREFIX_BYTES; i++)
+		nonce[m_extranonceBytes.size() + i] =
+				(unsigned char) (session->prefix >> (8 * (PROXY_PREFIX_BYTES - 1 - i)));
+	StratumToken soln = params[4];
+	soln.data += 6;
+	soln.size -= 6;
+	if (!params[3].decodeHex(nonce + nonce1Bytes)
+			|| !soln.decodeHex(solution->solution)) {
+		m_solutionPool.release(solution);
+		replyError(session, message.id, 20, "Invalid submit params");
+		return;
+	}
+
+	// The client sends the byte-swapped timestamp back as the same hex
+	solution->timestamp = bswap_64(strtoull(params[2].str().c_str(), nullptr, 16));
+	solution->nonce1size = 2 * m_extranonceBytes.size();
+	solution->jobId = params[1].str();
+	solution->stale = std::find(m_liveJobs.begin(), m_liveJobs.end(),
+			solution->jobId) == m_liveJobs.end();
+	solution->source = 0;
+	solution->connection = m_connection;
+	solution->tag = (uint64_t) session->id << 32 | (uint32_t) message.id;
+	speed.AddShare();
+	if (!solutionFoundCallback || !solutionFoundCallback(solution)) {
+		m_solutionPool.release(solution);
+		replyError(session, message.id, 20, "Pool not connected");
+	}
+}
+
+void StratumProxy::setServerNonce(size_t source, const std::string& n1str) {
+	if (n1str.size() % 2 || n1str.size() / 2 + PROXY_PREFIX_BYTES >= 32)
+		throw std::logic_error("Extranonce too long to split");
+	BOOST_LOG_CUSTOM(info) << "Extranonce of the pool is " << n1str;
+	bool changed = !m_extranonce.empty();
+	m_extranonce = n1str;
+	m_extranonceBytes = ParseHex(n1str);
+
+	std::vector<SessionPtr> stale;
+	for (auto& entry : m_sessions) {
+		const SessionPtr& session = entry.second;
+		if (!session->subscribed) {
+			if (session->subscribeId)
+				answerSubscribe(session);
+		} else if (changed && session->extranonceSubscribed) {
+			send(session, "{\"id\":null,\"method\":\"mining.set_extranonce\",\"params\":[\""
+					+ extranonceOf(*session) + "\"]}\n");
+		} else if (changed) {
+			// Its shares would not match the new extranonce
+			stale.push_back(session);
+		}
+	}
+	for (const SessionPtr& session : stale)
+		close(session);
+}
+
+void StratumProxy::parseJob(size_t source, const StratumField& params,
+		ProxyJob& job) {
+	if (params.count < 1 || !params[0].is(StratumToken::Type::String))
+		throw std::logic_error("Invalid job params");
+	job.job.assign(params[0].data, params[0].size);
+	std::string* notify = new std::string(
+			"{\"id\":null,\"method\":\"mining.notify\",\"params\":");
+	notify->append(params.value.data, params.value.size);
+	notify->append("}\n");
+	job.notify.reset(notify);
+	job.clean = params.count < 2 || !params[1].is(StratumToken::Type::Bool)
+			|| params[1].boolean;
+	job.source = source;
+	job.connection = 0;
+}
+
+void StratumProxy::setShareTarget(size_t source, const uint256* target) {
+	if (!target)
+		return;
+	std::string line = "{\"id\":null,\"method\":\"mining.set_target\",\"params\":[\""
+			+ target->GetHex() + "\"]}\n";
+	if (line == m_setTarget)
+		return;
+	m_setTarget = line;
+	for (auto& entry : m_sessions)
+		if (entry.second->subscribed)
+			send(entry.second, m_setTarget);
+}
+
+void StratumProxy::setJob(size_t source, ProxyJob* job) {
+	// Miners keep their last job while the pool is away
+	if (!job)
+		return;
+	m_job = job->job;
+	if (job->clean)
+		m_liveJobs.clear();
+	else if (m_liveJobs.size() == PROXY_MAX_LIVE_JOBS)
+		m_liveJobs.pop_front();
+	m_liveJobs.push_back(m_job);
+	m_notify = job->notify;
+	m_connection = job->connection;
+	for (auto& entry : m_sessions)
+		sendJob(entry.second);
+}
+
+void StratumProxy::onSolutionFound(
+		const std::function<bool(EquihashSolution*)> callback) {
+	solutionFoundCallback = callback;
+}
+
+void StratumProxy::acceptedSolution(size_t source, bool stale, uint64_t tag) {
+	speed.AddShareOK();
+	if (stale)
+		speed.StaleShareAnswered(true);
+	auto session = m_sessions.find((uint32_t) (tag >> 32));
+	if (session != m_sessions.end())
+		reply(session->second, (int) (uint32_t) tag, "true");
+}
+
+void StratumProxy::rejectedSolution(size_t source, bool stale, uint64_t tag,
+		const std::string& reason) {
+	speed.AddShareRejected();
+	if (stale)
+		speed.StaleShareAnswered(false);
+	auto session = m_sessions.find((uint32_t) (tag >> 32));
+	if (session != m_sessions.end())
+		replyError(session->second, (int) (uint32_t) tag, 20, reason);
+}
+
+void StratumProxy::answerSubscribe(const SessionPtr& session) {
+	session->subscribed = true;
+	reply(session, session->subscribeId, "[null,\"" + extranonceOf(*session) + "\"]");
+	if (!m_setTarget.empty())
+		send(session, m_setTarget);
+	sendJob(session);
+}
+
+void StratumProxy::sendJob(const SessionPtr& session) {
+	if (m_notify && session->subscribed && session->authorized)
+		send(session, m_notify);
+}
+
+void StratumProxy::reply(const SessionPtr& session, int id,
+		const std::string& result) {
+	send(session, "{\"id\":" + std::to_string(id) + ",\"result\":" + result
+			+ ",\"error\":null}\n");
+}
+
+void StratumProxy::replyError(const SessionPtr& session, int id, int code,
+		const std::string& reason) {
+	send(session, "{\"id\":" + std::to_string(id) + ",\"result\":null,\"error\":["
+			+ std::to_string(code) + ",\"" + JsonEscape(reason) + "\",null]}\n");
+}
+
+void StratumProxy::send(const SessionPtr& session, const std::string& line) {
+	send(session, std::make_shared<const std::string>(line));
+}
+
+void StratumProxy::send(const SessionPtr& session,
+		std::shared_ptr<const std::string> line) {
+	if (!session->socket.is_open())
+		return;
+	session->writeQueue.push_back(std::move(line));
+	if (session->writeQueue.size() > 1)
+		return;
+	boost::asio::async_write(session->socket,
+			boost::asio::buffer(*session->writeQueue.front()),
+			boost::bind(&StratumProxy::onWritten, this, session,
+					boost::asio::placeholders::error));
+}
+
+void StratumProxy::onWritten(SessionPtr session,
+		const boost::system::error_code& ec) {
+	if (!session->socket.is_open())
+		return;
+	if (ec) {
+		close(session);
+		return;
+	}
+	session->writeQueue.pop_front();
+	if (!session->writeQueue.empty())
+		boost::asio::async_write(session->socket,
+				boost::asio::buffer(*session->writeQueue.front()),
+				boost::bind(&StratumProxy::onWritten, this, session,
+						boost::asio::placeholders::error));
+}
+
+void StratumProxy::close(SessionPtr session) {
+	if (!session->socket.is_open())
+		return;
+	// Pending handlers keep the session alive until they return
+	boost::system::error_code ignored;
+	session->socket.close(ignored);
+	BOOST_LOG_CUSTOM(info) << "Miner #" << session->id << " disconnected";
+	bool full = m_freePrefixes.empty() && m_nextPrefix >> (8 * PROXY_PREFIX_BYTES);
+	m_freePrefixes.push_back(session->prefix);
+	m_sessions.erase(session->id);
+	m_sessionCount = m_sessions.size();
+	if (full)
+		accept();
+}
+
+std::string StratumProxy::extranonceOf(const Session& session) const {
+	static const char hexDigits[] = "0123456789abcdef";
+	std::string extranonce = m_extranonce;
+	for (int shift = 8 * PROXY_PREFIX_BYTES - 4; shift >= 0; shift -= 4)
+		extranonce += hexDigits[(session.prefix >> shift) & 0xF];
+	return extranonce;
+}
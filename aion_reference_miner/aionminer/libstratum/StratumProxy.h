@@ -0,0 +1,144 @@
+#pragma once
+// Copyright (c) 2018 Aion Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "libstratum/AionStratum.h"
+#include "libstratum/StratumMessage.h"
+
+#include <boost/asio.hpp>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Nonce bytes the proxy appends to the pool's extranonce for each miner,
+// which bounds the number of miners served at once
+#define PROXY_PREFIX_BYTES 2
+// Shares of all miners waiting for the pool's answer
+#define PROXY_MAX_SOLUTIONS 1024
+// Longest line a miner may send, past it the miner is dropped
+#define PROXY_MAX_LINE 10240
+// Jobs since the last clean one whose shares are not counted stale
+#define PROXY_MAX_LIVE_JOBS 16
+
+/**
+ * An upstream job as the proxy forwards it, the notify line is built once
+ * and shared by the write queues of all miners.
+ */
+struct ProxyJob
+{
+	std::string job;
+	std::shared_ptr<const std::string> notify;
+	bool clean;
+	size_t source;
+	size_t connection;
+};
+
+/**
+ * Serves downstream miners on a local acceptor and stands in for the miner
+ * of one upstream StratumClient, so all of them share its pool session.
+ * Each miner's extranonce is the pool's with a prefix of its own appended,
+ * which keeps their nonce ranges apart. Notifies go out as the pool sent
+ * them, submits go upstream under the client's share ids and carry the
+ * miner's session and request id as their tag, so the pool's answer is
+ * routed back. Everything runs on the client's I/O thread, but for stop().
+ */
+class StratumProxy
+{
+public:
+	// Binds the acceptor, throws std::runtime_error if it cannot
+	StratumProxy(std::shared_ptr<boost::asio::io_service> io_service,
+			const std::string& host, const std::string& port);
+	~StratumProxy();
+
+	// The miner interface StratumClient drives
+	std::string userAgent();
+	void start();
+	// Closes the acceptor and every miner, from any thread
+	void stop();
+	bool isMining() { return m_isActive; }
+	unsigned int getWeight(size_t source) const { return 1; }
+	void setServerNonce(size_t source, const std::string& n1str);
+	// Passed on to the miners as mining.set_target, they keep the last one
+	// when it is cleared
+	void setShareTarget(size_t source, const uint256* target);
+	// Throws std::logic_error on invalid params, as AionMiner
+	void parseJob(size_t source, const StratumField& params, ProxyJob& job);
+	void setJob(size_t source, ProxyJob* job);
+	// The callback takes ownership of the solution when it returns true and
+	// must hand it back through releaseSolution
+	void onSolutionFound(const std::function<bool(EquihashSolution* solution)> callback);
+	void releaseSolution(EquihashSolution* solution) { m_solutionPool.release(solution); }
+	void acceptedSolution(size_t source, bool stale, uint64_t tag);
+	void rejectedSolution(size_t source, bool stale, uint64_t tag, const std::string& reason);
+
+	size_t getSessionCount() const { return m_sessionCount; }
+
+private:
+	// One downstream miner
+	struct Session
+	{
+		uint32_t id;
+		uint16_t prefix;
+		boost::asio::ip::tcp::socket socket;
+		boost::asio::streambuf readBuffer;
+		std::deque<std::shared_ptr<const std::string>> writeQueue; // front is being written
+		int subscribeId; // answered once the pool's extranonce is known
+		bool subscribed;
+		bool authorized;
+		bool extranonceSubscribed;
+		std::string worker;
+
+		Session(boost::asio::io_service& io_service, uint32_t id, uint16_t prefix);
+	};
+	typedef std::shared_ptr<Session> SessionPtr;
+
+	void accept();
+	void onAccepted(SessionPtr session, const boost::system::error_code& ec);
+	void read(SessionPtr session);
+	void onRead(SessionPtr session, const boost::system::error_code& ec, size_t length);
+	void process(const SessionPtr& session, const StratumMessage& message);
+	void submit(const SessionPtr& session, const StratumMessage& message);
+	void send(const SessionPtr& session, std::shared_ptr<const std::string> line);
+	void send(const SessionPtr& session, const std::string& line);
+	void onWritten(SessionPtr session, const boost::system::error_code& ec);
+	void reply(const SessionPtr& session, int id, const std::string& result);
+	void replyError(const SessionPtr& session, int id, int code, const std::string& reason);
+	void answerSubscribe(const SessionPtr& session);
+	void sendJob(const SessionPtr& session);
+	void close(SessionPtr session);
+	std::string extranonceOf(const Session& session) const;
+
+	std::shared_ptr<boost::asio::io_service> m_io_service;
+	boost::asio::ip::tcp::acceptor m_acceptor;
+	std::atomic<bool> m_isActive;
+
+	std::unordered_map<uint32_t, SessionPtr> m_sessions;
+	std::atomic<size_t> m_sessionCount;
+	uint32_t m_nextSession;
+	// Prefixes of closed sessions, handed out again before new ones. The
+	// oldest goes first so a reconnecting miner rarely gets the prefix
+	// whose shares are still in flight
+	std::deque<uint16_t> m_freePrefixes;
+	uint32_t m_nextPrefix;
+
+	// The pool's extranonce, hex and decoded
+	std::string m_extranonce;
+	std::vector<unsigned char> m_extranonceBytes;
+	// Last job of the pool, null while it has none
+	std::string m_job;
+	// Jobs since the last clean one, the last is m_job
+	std::deque<std::string> m_liveJobs;
+	std::shared_ptr<const std::string> m_notify;
+	size_t m_connection;
+	// mining.set_target line of the pool's share target, empty while none
+	std::string m_setTarget;
+
+	SolutionPool m_solutionPool;
+	std::function<bool(EquihashSolution*)> solutionFoundCallback;
+};
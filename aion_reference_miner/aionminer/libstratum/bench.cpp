@@ -0,0 +1,137 @@
+// Copyright (c) 2018 Aion Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Measures the time from a mining.notify line to AionMiner::setJob, once
+// through json_spirit as the client used to and once through the in-situ
+// StratumMessage parser, on the same lines.
+//
+// Usage: stratum-bench [notifies]
+
+#include "libstratum/AionStratum.h"
+#include "libstratum/StratumMessage.h"
+
+#include "json/json_spirit_reader_template.h"
+#include "json/json_spirit_utils.h"
+
+#include <boost/log/core.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace json_spirit;
+
+typedef std::chrono::steady_clock Clock;
+
+static std::vector<std::string> MakeNotifies(size_t count) {
+	std::mt19937_64 random(42);
+	std::vector<std::string> lines;
+	lines.reserve(count);
+	for (size_t i = 0; i < count; i++) {
+		char header[65];
+		for (int j = 0; j < 64; j += 16)
+			snprintf(header + j, 17, "%016llx", (unsigned long long) random());
+		lines.push_back("{\"id\":null,\"method\":\"mining.notify\",\"params\":[\""
+				+ std::to_string(i + 1) + "\",true,\"00000000ffff"
+				"0000000000000000000000000000000000000000000000000000\",\""
+				+ header + "\"]}");
+	}
+	return lines;
+}
+
+static void Report(const char* name, std::vector<double>& ns) {
+	std::sort(ns.begin(), ns.end());
+	double total = 0;
+	for (double n : ns)
+		total += n;
+	printf("%-12s mean %8.0f ns  p50 %8.0f ns  p99 %8.0f ns  max %8.0f ns\n",
+			name, total / ns.size(), ns[ns.size() / 2],
+			ns[ns.size() * 99 / 100], ns.back());
+}
+
+// The json_spirit path: a string copy of the line, a Value tree, lookups
+// by name and a heap-allocated job
+static bool JsonSpiritNotify(AionMiner& miner, const std::string& line,
+		AionJob& out) {
+	std::string response(line.data(), line.size());
+	Value valResponse;
+	if (!read_string(response, valResponse) || valResponse.type() != obj_type)
+		return false;
+	const Object& responseObject = valResponse.get_obj();
+	const Value& valMethod = find_value(responseObject, "method");
+	if (valMethod.type() != str_type || valMethod.get_str() != "mining.notify")
+		return false;
+	const Value& valParams = find_value(responseObject, "params");
+	if (valParams.type() != array_type)
+		return false;
+	AionJob* job = miner.parseJob(0, valParams.get_array());
+	miner.setJob(0, job);
+	memcpy(out.input, job->input, sizeof(out.input));
+	memcpy(out.targetBytes, job->targetBytes, sizeof(out.targetBytes));
+	out.job = job->job;
+	delete job;
+	return true;
+}
+
+// The in-situ path, into a reused job
+static bool InSituNotify(AionMiner& miner, const std::string& line,
+		StratumMessage& message, AionJob& job) {
+	if (!ParseStratumMessage(line.data(), line.size(), message)
+			|| message.method != StratumMessage::Method::Notify)
+		return false;
+	miner.parseJob(0, message.params, job);
+	miner.setJob(0, &job);
+	return true;
+}
+
+int main(int argc, char* argv[]) {
+	size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+	if (!count) {
+		std::cerr << "Usage: " << argv[0] << " [notifies]" << std::endl;
+		return 1;
+	}
+	boost::log::core::get()->set_logging_enabled(false);
+
+	std::vector<std::string> lines = MakeNotifies(count);
+	std::vector<ISolver *> solvers;
+	AionMiner miner(solvers);
+	miner.setServerNonce(0, "01020304");
+
+	// Both paths must build the same job
+	StratumMessage message;
+	AionJob expected, job;
+	for (size_t i = 0; i < std::min<size_t>(count, 1000); i++) {
+		if (!JsonSpiritNotify(miner, lines[i], expected)
+				|| !InSituNotify(miner, lines[i], message, job)
+				|| expected.job != job.job
+				|| memcmp(expected.input, job.input, sizeof(job.input))
+				|| memcmp(expected.targetBytes, job.targetBytes, sizeof(job.targetBytes))) {
+			std::cerr << "Parsers disagree on: " << lines[i] << std::endl;
+			return 1;
+		}
+	}
+
+	std::vector<double> jsonNs(count), inSituNs(count);
+	for (size_t i = 0; i < count; i++) {
+		auto start = Clock::now();
+		JsonSpiritNotify(miner, lines[i], expected);
+		jsonNs[i] = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+	}
+	for (size_t i = 0; i < count; i++) {
+		auto start = Clock::now();
+		InSituNotify(miner, lines[i], message, job);
+		inSituNs[i] = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+	}
+
+	printf("%zu notifies, line to setJob:\n", count);
+	Report("json_spirit", jsonNs);
+	Report("in-situ", inSituNs);
+	return 0;
+}
@@ -18,6 +18,7 @@
 #include <chrono>
 #include <atomic>
 #include <bitset>
+#include <fstream>
 
 #include "speed.hpp"
 #include "api.hpp"
@@ -64,17 +65,44 @@ MinerFactory *_MinerFactory = nullptr;
 // stratum client sig
 //static ZcashStratumClient* scSig = nullptr;
 
-// stratum client sig
-static AionStratumClient* scSig = nullptr;
+// stratum client sig, one per pool
+static std::vector<AionStratumClient*> scSig;
+// upstream client of --proxy
+static ProxyStratumClient* proxySig = nullptr;
+
+// Latency histograms are written here on exit when set
+static std::string histogramFile;
+static std::string apiAddress = "127.0.0.1";
+
+static void write_histograms()
+{
+	if (histogramFile.empty())
+		return;
+	std::ofstream out(histogramFile);
+	if (!out)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Cannot write histograms to " << histogramFile;
+		return;
+	}
+	speed.PrintHistograms(out);
+	BOOST_LOG_TRIVIAL(info) << "Latency histograms written to " << histogramFile;
+}
 
 extern "C" void stratum_sigint_handler(int signum)
 {
-	if (scSig) {
-		scSig->disconnect();
-		delete scSig;
-		scSig = nullptr;
+	for (AionStratumClient* sc : scSig)
+		sc->disconnect();
+	for (AionStratumClient* sc : scSig)
+		delete sc;
+	scSig.clear();
+	if (proxySig) {
+		proxySig->disconnect();
+		delete proxySig;
+		proxySig = nullptr;
 	}
 
+	write_histograms();
+
 	if (_MinerFactory) {
 		_MinerFactory->ClearAllSolvers();
 		delete _MinerFactory;
@@ -204,54 +232,248 @@ void detect_AVX_and_AVX2()
 }
 
 
-void start_mining(int api_port, const std::string& host, const std::string& port,
+// A pool given with -l, and its -w weight and -f standby at the same position
+struct PoolConfig
+{
+	std::string host;
+	std::string port;
+	unsigned int weight;
+	std::string failover;
+};
+
+static void split_location(const std::string& location, std::string& host, std::string& port)
+{
+	size_t delim = location.find(':');
+	host = delim != std::string::npos ? location.substr(0, delim) : location;
+	port = delim != std::string::npos ? location.substr(delim + 1) : "3333";
+}
+
+void start_mining(int api_port, const std::vector<PoolConfig>& pools,
 	const std::string& user, const std::string& password,
 	//ZcashStratumClient* handler, const std::vector<ISolver *> &i_solvers)
-	AionStratumClient** handler, const std::vector<ISolver *> &i_solvers)
+	std::vector<AionStratumClient*>& handlers, const std::vector<ISolver *> &i_solvers)
 
 {
 	std::shared_ptr<boost::asio::io_service> io_service(new boost::asio::io_service);
 
+	std::vector<unsigned int> weights;
+	for (const PoolConfig& pool : pools)
+		weights.push_back(pool.weight);
+	AionMiner miner(i_solvers, weights);
+
+	// Solutions go back to the client of the pool their job came from
+	std::vector<std::atomic<AionStratumClient*>> clients(pools.size());
+	miner.onSolutionFound([&](EquihashSolution* solution) {
+		AionStratumClient* sc = clients[solution->source];
+		return sc && sc->submit(solution);
+	});
+
+	// Each client runs its own I/O thread
+	for (size_t i = 0; i < pools.size(); ++i)
+	{
+		AionStratumClient *sc = new AionStratumClient {
+			i ? std::make_shared<boost::asio::io_service>() : io_service,
+			&miner, pools[i].host, pools[i].port, user, password, 0, i
+		};
+		if (!pools[i].failover.empty())
+		{
+			std::string host, port;
+			split_location(pools[i].failover, host, port);
+			sc->setFailover(host, port);
+		}
+		clients[i] = sc;
+	}
+
+	for (size_t i = 0; i < pools.size(); ++i)
+		handlers.push_back(clients[i]);
+
 	API* api = nullptr;
 	if (api_port > 0)
 	{
-		api = new API(io_service);
-		if (!api->start(api_port))
+		api = new API();
+		auto pause = [&miner](bool paused) {
+			return [&miner, paused](const StratumField& params, const API::Reply& reply) {
+				if (params.count < 1 || !params[0].is(StratumToken::Type::Number) ||
+					params[0].toInt() < 0 || !miner.pauseSolver(params[0].toInt(), paused))
+					reply("", "No such solver");
+				else
+					reply("true", "");
+			};
+		};
+		api->addCommand("pause_solver", pause(true));
+		api->addCommand("resume_solver", pause(false));
+		// Only threads started with -t can run, their solvers are not
+		// allocated again
+		api->addCommand("set_threads", [&miner](const StratumField& params, const API::Reply& reply) {
+			size_t started = miner.getCpuSolverCount();
+			if (params.count < 1 || !params[0].is(StratumToken::Type::Number) || params[0].toInt() < 0)
+				reply("", "Expected a thread count");
+			else if ((size_t)params[0].toInt() > started)
+				reply("", std::to_string(started) + " CPU threads were started, restart with -t for more");
+			else
+			{
+				miner.setCpuThreads(params[0].toInt());
+				reply("{\"threads\":" + std::to_string(params[0].toInt()) +
+					",\"started\":" + std::to_string(started) + "}", "");
+			}
+		});
+		api->addCommand("switch_pool", [&clients](const StratumField& params, const API::Reply& reply) {
+			std::shared_ptr<PoolStats> pool;
+			if (params.count && params[0].is(StratumToken::Type::Number) && params[0].toInt() >= 0)
+				pool = speed.GetPool(params[0].toInt());
+			if (!pool)
+			{
+				reply("", "No such pool");
+				return;
+			}
+			clients[pool->source].load()->switchPool(params[0].toInt(), [reply](const std::string& error) {
+				reply(error.empty() ? "true" : "", error);
+			});
+		});
+		if (!api->start(api_port, apiAddress))
 		{
 			delete api;
 			api = nullptr;
 		}
 	}
 
-	AionMiner miner(i_solvers);
-	AionStratumClient *sc = new AionStratumClient {
-		io_service, &miner, host, port, user, password, 0, 0
-	};
-
-	miner.onSolutionFound([&](const EquihashSolution& solution, const std::string& jobid, uint64_t timestamp) {
-		return sc->submit(&solution, jobid, timestamp);
-	});
-
-	*handler = sc;
-
 	int c = 0;
-	while (sc->isRunning()) {
+	bool firstHashLogged = false;
+	// A client that gives up leaves the solvers to the others, mining stops
+	// with the last one
+	auto running = [&clients]() {
+		for (std::atomic<AionStratumClient*>& sc : clients)
+			if (sc.load()->isRunning())
+				return true;
+		return false;
+	};
+	while (running()) {
 		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		if (!firstHashLogged && speed.GetFirstHashLatency() >= 0)
+		{
+			BOOST_LOG_TRIVIAL(info) << "First hash " << speed.GetFirstHashLatency() << " ms after start";
+			firstHashLogged = true;
+		}
 		if (++c % 1000 == 0)
 		{
 			double allshares = speed.GetShareSpeed() * 60;
 			double accepted = speed.GetShareOKSpeed() * 60;
 			BOOST_LOG_TRIVIAL(info) << CL_YLW "Speed [" << INTERVAL_SECONDS << " sec]: " <<
 				speed.GetHashSpeed() << " I/s, " <<
-				speed.GetSolutionSpeed() << " Sols/s" <<
+				speed.GetSolutionSpeed() << " Sols/s (10s/60s/15m: " <<
+				speed.GetHashSpeed(SPEED_WINDOW_SHORT) << "/" <<
+				speed.GetHashSpeed(SPEED_WINDOW_MEDIUM) << "/" <<
+				speed.GetHashSpeed(SPEED_WINDOW_LONG) << " I/s)" <<
 				//accepted << " AS/min, " <<
 				//(allshares - accepted) << " RS/min"
 				CL_N;
+			if (speed.GetJobChanges())
+				BOOST_LOG_TRIVIAL(info) << "  Job changes: " << speed.GetJobChanges() << ", " <<
+					speed.GetWastedPerJobChange() << " solver-s wasted per change, " <<
+					speed.GetStaleRuns() << " stale runs finished, stale shares " <<
+					speed.GetStaleShares() << " found/" << speed.GetStaleAccepted() << " accepted/" <<
+					speed.GetStaleRejected() << " rejected";
+			if (speed.GetFilteredSolutions())
+				BOOST_LOG_TRIVIAL(info) << "  Filtered solutions: " << speed.GetFilteredSolutions() <<
+					" above the share target";
+			if (speed.GetPoolCount() > 1)
+				for (size_t i = 0; i < speed.GetPoolCount(); ++i)
+				{
+					std::shared_ptr<PoolStats> pool = speed.GetPool(i);
+					if (!pool)
+						continue;
+					BOOST_LOG_TRIVIAL(info) << "  Pool " << pool->name << " (weight " << pool->weight <<
+						(pool->active ? ", active" : "") << "): " <<
+						speed.GetPoolHashSpeed(*pool) << " I/s, " <<
+						pool->shares << " shares, " <<
+						speed.GetPoolSeconds(*pool) << " s mined";
+				}
+			for (size_t i = 0; i < speed.GetSolverCount(); ++i)
+			{
+				std::shared_ptr<SolverStats> solver = speed.GetSolver(i);
+				if (!solver)
+					continue;
+				BOOST_LOG_TRIVIAL(info) << "  #" << i << " " << solver->name << " " << solver->device << ": " <<
+					speed.GetSolverHashSpeed(*solver) << " I/s, " <<
+					speed.GetSolverSolutionSpeed(*solver) << " Sols/s, " <<
+					solver->shares << " shares, " <<
+					solver->wasted << " runs (" << solver->wasted_ms << " ms) lost to job switches" <<
+					(solver->paused ? ", paused" : "");
+			}
 		}
-		if (api) while (api->poll()) {}
 	}
 
 	if (api) delete api;
+	// Stops the miner and the I/O threads of clients that gave up
+	for (std::atomic<AionStratumClient*>& sc : clients)
+		sc.load()->disconnect();
+}
+
+// Serves miners on listen through one session with the pool, no solvers run
+void start_proxy(int api_port, const PoolConfig& pool, const std::string& listen,
+	const std::string& user, const std::string& password)
+{
+	std::shared_ptr<boost::asio::io_service> io_service(new boost::asio::io_service);
+
+	std::string host = "0.0.0.0", port = listen;
+	if (listen.find(':') != std::string::npos)
+		split_location(listen, host, port);
+	StratumProxy proxy(io_service, host, port);
+
+	std::atomic<ProxyStratumClient*> client { nullptr };
+	proxy.onSolutionFound([&](EquihashSolution* solution) {
+		ProxyStratumClient* sc = client;
+		return sc && sc->submit(solution);
+	});
+
+	// The proxy runs on the client's I/O thread
+	ProxyStratumClient *sc = new ProxyStratumClient {
+		io_service, &proxy, pool.host, pool.port, user, password, 0
+	};
+	if (!pool.failover.empty())
+	{
+		std::string failoverHost, failoverPort;
+		split_location(pool.failover, failoverHost, failoverPort);
+		sc->setFailover(failoverHost, failoverPort);
+	}
+	client = sc;
+	proxySig = sc;
+
+	API* api = nullptr;
+	if (api_port > 0)
+	{
+		api = new API();
+		api->addCommand("switch_pool", [sc](const StratumField& params, const API::Reply& reply) {
+			if (params.count < 1 || !params[0].is(StratumToken::Type::Number) || params[0].toInt() < 0)
+			{
+				reply("", "No such pool");
+				return;
+			}
+			sc->switchPool(params[0].toInt(), [reply](const std::string& error) {
+				reply(error.empty() ? "true" : "", error);
+			});
+		});
+		if (!api->start(api_port, apiAddress))
+		{
+			delete api;
+			api = nullptr;
+		}
+	}
+
+	int c = 0;
+	while (sc->isRunning()) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		if (++c % 1000 == 0)
+		{
+			BOOST_LOG_TRIVIAL(info) << CL_YLW "Proxy [" << INTERVAL_SECONDS << " sec]: " <<
+				proxy.getSessionCount() << " miners, " <<
+				speed.GetShareSpeed() * 60 << " shares/min, " <<
+				speed.GetShareOKSpeed() * 60 << " accepted/min" CL_N;
+		}
+	}
+
+	if (api) delete api;
+	sc->disconnect();
 }
 
 
@@ -267,7 +489,10 @@ int main(int argc, char* argv[])
 	std::cout << "\t============================= aion reference miner======================" << std::endl;
 	std::cout << std::endl;
 
-	std::string location = "localhost:3333";
+	std::vector<std::string> locations;
+	std::vector<unsigned int> weights;
+	std::vector<std::string> failovers;
+	std::string proxy_listen;
 	std::string user = "0x0000000000000000000000000000000000000000000000000000000000000000";
 	std::string password = "x";
 	int num_threads = 0;
@@ -287,11 +512,17 @@ int main(int argc, char* argv[])
     desc.add_options()
 	  //General settings 
       ("help,h", "Print help messages") 
-      ("location,l", boost::program_options::value<std::string>(&location), "Stratum server:port")
+      ("location,l", boost::program_options::value<std::vector<std::string>>(&locations)->composing()
+        ->default_value(std::vector<std::string>(1, "localhost:3333"), "localhost:3333"), "Stratum server:port, repeat to mine on several pools")
+      ("weight,w", boost::program_options::value<std::vector<unsigned int>>(&weights)->composing(), "Share of solver time of each pool (default 1 each)")
+      ("failover,f", boost::program_options::value<std::vector<std::string>>(&failovers)->composing(), "Backup stratum server:port of each pool, kept connected as hot standby")
+      ("proxy", boost::program_options::value<std::string>(&proxy_listen)->implicit_value("3334"), "Serve miners on [host:]port through one session with the pool, instead of mining (default port 3334)")
 	  ("username,u", boost::program_options::value<std::string>(&user), "Username (Aion Addess)")
 	  ("apiPort,a", boost::program_options::value<int>(&api_port), "Local port (default 0 = do not bind)")
+	  ("apiAddress", boost::program_options::value<std::string>(&apiAddress), "Address the API listens on, 0.0.0.0 for remote metrics scrapers (default 127.0.0.1)")
 	  ("level,d", boost::program_options::value<int>(&log_level), "Debug print level (0 = print all, 5 = fatal only, default: 2)")
 	  ("benchmark,b", boost::program_options::value<int>()->implicit_value(200), "Run in benchmark mode (default: 200 iterations)")
+	  ("histograms", boost::program_options::value<std::string>(&histogramFile), "Write latency histograms to file on exit")
 	  //CPU settings
 	  ("threads,t",  boost::program_options::value<int>(&num_threads), "Number of CPU threads")
 	  ("ext,e", boost::program_options::value<int>(&force_cpu_ext), "Force CPU ext (0 = SSE2, 1 = AVX, 2 = AVX2)")
@@ -415,14 +646,37 @@ int main(int argc, char* argv[])
 				return 0;
 			}
 
-			size_t delim = location.find(':');
-			std::string host = delim != std::string::npos ? location.substr(0, delim) : location;
-			std::string port = delim != std::string::npos ? location.substr(delim + 1) : "3333";
+			std::vector<PoolConfig> pools;
+			for (size_t i = 0; i < locations.size(); ++i)
+			{
+				PoolConfig pool;
+				split_location(locations[i], pool.host, pool.port);
+				pool.weight = i < weights.size() ? weights[i] : 1;
+				pool.failover = i < failovers.size() ? failovers[i] : std::string();
+				if (pool.weight == 0)
+				{
+					BOOST_LOG_TRIVIAL(error) << "Invalid weight for " << locations[i] << ", must be at least 1.";
+					return 0;
+				}
+				pools.push_back(pool);
+			}
 
-			start_mining(api_port, host, port, user, password,
-				&scSig,
-				_MinerFactory->GenerateSolvers(num_threads, cuda_device_count, cuda_enabled, cuda_blocks,
-				cuda_tpb));
+			if (vm.count("proxy"))
+			{
+				if (pools.size() != 1)
+				{
+					BOOST_LOG_TRIVIAL(error) << "Proxy mode takes a single pool.";
+					return 0;
+				}
+				start_proxy(api_port, pools[0], proxy_listen, user, password);
+			}
+			else
+			{
+				start_mining(api_port, pools, user, password,
+					scSig,
+					_MinerFactory->GenerateSolvers(num_threads, cuda_device_count, cuda_enabled, cuda_blocks,
+					cuda_tpb));
+			}
 		}
 		else
 		{
@@ -434,6 +688,7 @@ int main(int argc, char* argv[])
 		BOOST_LOG_TRIVIAL(error) << er.what();
 	}
 
+	write_histograms();
 	boost::log::core::get()->remove_all_sinks();
 
 	return 0;
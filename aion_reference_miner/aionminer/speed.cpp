@@ -1,112 +1,605 @@
+#include <algorithm>
+#include <iomanip>
 #include <iostream>
 #include <chrono>
+#include <stdexcept>
 #include <vector>
-#include <mutex>
 
 #include "speed.hpp"
 
 
-Speed::Speed(int interval) 
-	: m_interval(interval), m_start(std::chrono::high_resolution_clock::now()) {}
-Speed::~Speed() { }
+// Writer threads are spread over the shards in the order they first add
+static std::atomic<unsigned> nextShard(0);
 
-void Speed::Add(std::vector<time_point>& buffer, std::mutex& mutex)
+static size_t ThreadShard()
 {
-	mutex.lock();
-	buffer.push_back(std::chrono::high_resolution_clock::now());
-	mutex.unlock();
+	static thread_local unsigned shard = nextShard++ % SPEED_SHARDS;
+	return shard;
 }
 
-double Speed::Get(std::vector<time_point>& buffer, std::mutex& mutex)
+static uint32_t CurrentSecond()
 {
-	time_point now = std::chrono::high_resolution_clock::now();
-	time_point past = now - std::chrono::seconds(m_interval);
-	double interval = (double)m_interval;
-	if (past < m_start)
+	return (uint32_t)std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+RateMeter::RateMeter(size_t shards) : m_shards(shards)
+{
+	Reset();
+}
+
+void RateMeter::Add(uint32_t second)
+{
+	std::atomic<uint64_t>& slot = m_shards[ThreadShard() % m_shards.size()].slots[second % SPEED_SLOTS];
+	uint64_t word = slot.load(std::memory_order_relaxed);
+	uint64_t next;
+	do
 	{
-		interval = ((double)std::chrono::duration_cast<std::chrono::milliseconds>(now - m_start).count()) / 1000;
-		past = m_start;
-	}
-	size_t total = 0;
+		// A slot still holding an older second starts over
+		next = (word >> 32) == second ? word + 1 : ((uint64_t)second << 32) | 1;
+	} while (!slot.compare_exchange_weak(word, next, std::memory_order_relaxed));
+}
 
-	mutex.lock();
-	for (std::vector<time_point>::iterator it = buffer.begin(); it != buffer.end();)
+double RateMeter::Get(uint32_t now, uint32_t window)
+{
+	if (window == 0)
+		return 0;
+	uint64_t total = 0;
+	for (Shard& shard : m_shards)
 	{
-		if ((*it) < past)
-		{
-			it = buffer.erase(it);
-		}
-		else
+		for (uint32_t second = now - window; second != now; second++)
 		{
-			++total;
-			++it;
+			uint64_t word = shard.slots[second % SPEED_SLOTS].load(std::memory_order_relaxed);
+			if ((word >> 32) == second)
+				total += word & 0xffffffff;
 		}
 	}
-	mutex.unlock();
+	return (double)total / window;
+}
+
+void RateMeter::Reset()
+{
+	for (Shard& shard : m_shards)
+		for (std::atomic<uint64_t>& slot : shard.slots)
+			slot.store(0, std::memory_order_relaxed);
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+	Reset();
+}
+
+size_t LatencyHistogram::Index(uint64_t value)
+{
+	if (value < 2 * HIST_SUB_BUCKETS)
+		return (size_t)value;
+	if (value >> HIST_MAX_BITS)
+		value = ((uint64_t)1 << HIST_MAX_BITS) - 1;
+	unsigned int shift = 0;
+	while (value >> (shift + HIST_SUB_BUCKET_BITS + 1))
+		shift++;
+	// value >> shift is in [HIST_SUB_BUCKETS, 2 * HIST_SUB_BUCKETS)
+	return (size_t)(shift * HIST_SUB_BUCKETS + (value >> shift));
+}
+
+uint64_t LatencyHistogram::HighestEquivalent(size_t index)
+{
+	if (index < 2 * HIST_SUB_BUCKETS)
+		return index;
+	unsigned int shift = (unsigned int)(index / HIST_SUB_BUCKETS - 1);
+	uint64_t lowest = (uint64_t)(index - shift * HIST_SUB_BUCKETS) << shift;
+	return lowest + ((uint64_t)1 << shift) - 1;
+}
 
-	return (double)total / (double)interval;
+void LatencyHistogram::Record(uint64_t us)
+{
+	m_counts[Index(us)].fetch_add(1, std::memory_order_relaxed);
+	m_sum.fetch_add(us, std::memory_order_relaxed);
+	uint64_t min = m_min.load(std::memory_order_relaxed);
+	while (us < min && !m_min.compare_exchange_weak(min, us, std::memory_order_relaxed)) {}
+	uint64_t max = m_max.load(std::memory_order_relaxed);
+	while (us > max && !m_max.compare_exchange_weak(max, us, std::memory_order_relaxed)) {}
+	// Last, so a reader that sees the count sees the bucket
+	m_total.fetch_add(1, std::memory_order_release);
 }
 
-void Speed::AddHash()
+uint64_t LatencyHistogram::Count() const
 {
-	Add(m_buffer_hashes, m_mutex_hashes);
+	return m_total.load(std::memory_order_acquire);
 }
 
-double Speed::GetHashSpeed()
+uint64_t LatencyHistogram::Sum() const
 {
-	return Get(m_buffer_hashes, m_mutex_hashes);
+	return m_sum.load(std::memory_order_relaxed);
 }
 
-void Speed::AddSolution()
+uint64_t LatencyHistogram::Min() const
 {
-	Add(m_buffer_solutions, m_mutex_solutions);
+	return Count() ? m_min.load(std::memory_order_relaxed) : 0;
 }
 
-double Speed::GetSolutionSpeed()
+uint64_t LatencyHistogram::Max() const
 {
-	return Get(m_buffer_solutions, m_mutex_solutions);
+	return m_max.load(std::memory_order_relaxed);
+}
+
+double LatencyHistogram::Mean() const
+{
+	uint64_t count = Count();
+	return count ? (double)m_sum.load(std::memory_order_relaxed) / count : 0;
+}
+
+uint64_t LatencyHistogram::Percentile(double percent) const
+{
+	uint64_t total = Count();
+	if (!total)
+		return 0;
+	uint64_t target = (uint64_t)(percent / 100 * total + 0.5);
+	if (target < 1)
+		target = 1;
+	uint64_t seen = 0;
+	for (size_t i = 0; i < HIST_BUCKETS; i++)
+	{
+		seen += m_counts[i].load(std::memory_order_relaxed);
+		if (seen >= target)
+			return std::min(HighestEquivalent(i), Max());
+	}
+	return Max();
+}
+
+uint64_t LatencyHistogram::Cumulative(const uint64_t* bounds, size_t count, uint64_t* out) const
+{
+	uint64_t total = Count();
+	uint64_t seen = 0;
+	size_t bound = 0;
+	for (size_t i = 0; i < HIST_BUCKETS && seen < total; i++)
+	{
+		uint64_t n = m_counts[i].load(std::memory_order_relaxed);
+		if (!n)
+			continue;
+		for (; bound < count && HighestEquivalent(i) > bounds[bound]; bound++)
+			out[bound] = seen;
+		seen += n;
+	}
+	for (; bound < count; bound++)
+		out[bound] = seen;
+	return seen;
+}
+
+void LatencyHistogram::Print(std::ostream& out) const
+{
+	uint64_t total = Count();
+	out << "       Value(ms)   Percentile   TotalCount" << std::endl;
+	uint64_t seen = 0;
+	for (size_t i = 0; i < HIST_BUCKETS && seen < total; i++)
+	{
+		uint64_t count = m_counts[i].load(std::memory_order_relaxed);
+		if (!count)
+			continue;
+		seen += count;
+		out << std::fixed << std::setprecision(3) << std::setw(16)
+			<< (double)std::min(HighestEquivalent(i), Max()) / 1000
+			<< std::setprecision(6) << std::setw(13) << (double)seen / total
+			<< std::setw(13) << seen << std::endl;
+	}
+	out << std::setprecision(3) << "#[Mean = " << Mean() / 1000 << ", Min = "
+		<< (double)Min() / 1000 << ", Max = " << (double)Max() / 1000
+		<< ", Total count = " << total << "]" << std::endl;
+	out.unsetf(std::ios_base::floatfield);
+}
+
+void LatencyHistogram::Reset()
+{
+	for (std::atomic<uint64_t>& count : m_counts)
+		count.store(0, std::memory_order_relaxed);
+	m_sum = 0;
+	m_min = UINT64_MAX;
+	m_max = 0;
+	m_total = 0;
+}
+
+SolverStats::SolverStats(const std::string& name, const std::string& device)
+	: name(name), device(device), hashes(1), solutions(1), paused(false)
+{
+	Reset();
+}
+
+void SolverStats::Reset()
+{
+	hashes.Reset();
+	solutions.Reset();
+	hash_count = 0;
+	solution_count = 0;
+	shares = 0;
+	wasted = 0;
+	wasted_ms = 0;
+	memory = 0;
+	solve_time.Reset();
+}
+
+PoolStats::PoolStats(const std::string& name, size_t source, unsigned int weight)
+	: name(name), source(source), weight(weight), hashes(1), connected(false), active(false)
+{
+	Reset();
+}
+
+void PoolStats::Reset()
+{
+	hashes.Reset();
+	shares = 0;
+	active_us = 0;
+	active_since = std::chrono::steady_clock::now();
+}
+
+Speed::Speed(int interval) 
+	: m_interval(interval), m_start(std::chrono::high_resolution_clock::now()), m_start_second(CurrentSecond()),
+	m_share_count(0), m_share_ok_count(0), m_share_rejected_count(0),
+	m_first_hash_us(-1), m_submit_queue(0), m_submit_count(0), m_submit_latency_total_us(0), m_submit_latency_max_us(0),
+	m_stale_shares(0), m_stale_accepted(0), m_stale_rejected(0), m_stale_runs(0), m_filtered_solutions(0),
+	m_job_changes(0), m_wasted_us(0), m_pool_count(0) {}
+Speed::~Speed() { }
+
+double Speed::Get(RateMeter& meter, int window)
+{
+	uint32_t now = CurrentSecond();
+	uint32_t elapsed = now - m_start_second.load();
+	if (window <= 0)
+		window = m_interval;
+	if (window > SPEED_WINDOW_LONG)
+		window = SPEED_WINDOW_LONG;
+	// Shortly after start only the seconds since then count
+	return meter.Get(now, (uint32_t)window < elapsed ? (uint32_t)window : elapsed);
+}
+
+void Speed::InitSolver(size_t pos, const std::string& name, const std::string& device)
+{
+	std::lock_guard<std::mutex> lock(m_solvers_mutex);
+	// Mining threads are stopped, so the vector itself may change here
+	if (m_solvers.size() <= pos)
+		m_solvers.resize(pos + 1);
+	if (m_solvers[pos] && m_solvers[pos]->name == name && m_solvers[pos]->device == device)
+		m_solvers[pos]->Reset();
+	else
+		m_solvers[pos].reset(new SolverStats(name, device));
+}
+
+size_t Speed::GetSolverCount()
+{
+	std::lock_guard<std::mutex> lock(m_solvers_mutex);
+	return m_solvers.size();
+}
+
+std::shared_ptr<SolverStats> Speed::GetSolver(size_t pos)
+{
+	std::lock_guard<std::mutex> lock(m_solvers_mutex);
+	return pos < m_solvers.size() ? m_solvers[pos] : nullptr;
+}
+
+double Speed::GetSolverHashSpeed(SolverStats& solver, int window)
+{
+	return Get(solver.hashes, window);
+}
+
+double Speed::GetSolverSolutionSpeed(SolverStats& solver, int window)
+{
+	return Get(solver.solutions, window);
+}
+
+void Speed::AddSolverShare(size_t solver)
+{
+	++m_solvers[solver]->shares;
+}
+
+void Speed::AddSolveTime(size_t solver, double seconds, bool cancelled)
+{
+	SolverStats& stats = *m_solvers[solver];
+	uint64_t us = (uint64_t)(seconds * 1000000);
+	if (cancelled)
+	{
+		++stats.wasted;
+		stats.wasted_ms += us / 1000;
+		m_wasted_us += us;
+		return;
+	}
+	stats.solve_time.Record(us);
+}
+
+void Speed::SetSolverMemory(size_t solver, uint64_t bytes)
+{
+	m_solvers[solver]->memory.store(bytes, std::memory_order_relaxed);
+}
+
+void Speed::SetSolverPaused(size_t solver, bool paused)
+{
+	std::shared_ptr<SolverStats> stats = GetSolver(solver);
+	if (stats)
+		stats->paused = paused;
+}
+
+void Speed::AddHash(size_t solver)
+{
+	if (m_first_hash_us.load(std::memory_order_relaxed) < 0)
+	{
+		int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::high_resolution_clock::now() - m_start).count();
+		int64_t unset = -1;
+		m_first_hash_us.compare_exchange_strong(unset, us);
+	}
+	uint32_t now = CurrentSecond();
+	m_hashes.Add(now);
+	m_solvers[solver]->hashes.Add(now);
+	m_solvers[solver]->hash_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+double Speed::GetHashSpeed(int window)
+{
+	return Get(m_hashes, window);
+}
+
+void Speed::AddSolution(size_t solver)
+{
+	uint32_t now = CurrentSecond();
+	m_solutions.Add(now);
+	m_solvers[solver]->solutions.Add(now);
+	m_solvers[solver]->solution_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+double Speed::GetSolutionSpeed(int window)
+{
+	return Get(m_solutions, window);
 }
 
 void Speed::AddShare()
 {
-	Add(m_buffer_shares, m_mutex_shares);
+	m_shares.Add(CurrentSecond());
+	++m_share_count;
 }
 
-double Speed::GetShareSpeed()
+double Speed::GetShareSpeed(int window)
 {
-	return Get(m_buffer_shares, m_mutex_shares);
+	return Get(m_shares, window);
 }
 
 void Speed::AddShareOK()
 {
-	Add(m_buffer_shares_ok, m_mutex_shares_ok);
+	m_shares_ok.Add(CurrentSecond());
+	++m_share_ok_count;
 }
 
+void Speed::AddShareRejected()
+{
+	++m_share_rejected_count;
+}
 
-double Speed::GetShareOKSpeed()
+double Speed::GetShareOKSpeed(int window)
 {
-	return Get(m_buffer_shares_ok, m_mutex_shares_ok);
+	return Get(m_shares_ok, window);
 }
 
-void Speed::Reset()
+void Speed::AddStaleShare()
+{
+	++m_stale_shares;
+}
+
+void Speed::StaleShareAnswered(bool accepted)
+{
+	if (accepted)
+		++m_stale_accepted;
+	else
+		++m_stale_rejected;
+}
+
+void Speed::AddStaleRun()
+{
+	++m_stale_runs;
+}
+
+void Speed::AddFilteredSolution()
+{
+	++m_filtered_solutions;
+}
+
+void Speed::AddJobChange()
+{
+	++m_job_changes;
+}
+
+double Speed::GetWastedSeconds()
+{
+	return (double)m_wasted_us.load() / 1000000;
+}
+
+double Speed::GetWastedPerJobChange()
+{
+	uint64_t changes = m_job_changes.load();
+	return changes ? (double)m_wasted_us.load() / changes / 1000000 : 0;
+}
+
+size_t Speed::AddPool(const std::string& name, size_t source, unsigned int weight)
+{
+	std::lock_guard<std::mutex> lock(m_pools_mutex);
+	size_t pool = m_pool_count.load(std::memory_order_relaxed);
+	if (pool == SPEED_MAX_POOLS)
+		throw std::length_error("Too many pool connections");
+	m_pools[pool].reset(new PoolStats(name, source, weight));
+	m_pool_count.store(pool + 1, std::memory_order_release);
+	return pool;
+}
+
+void Speed::SetPoolConnected(size_t pool, bool connected)
+{
+	std::shared_ptr<PoolStats> stats = GetPool(pool);
+	if (stats)
+		stats->connected = connected;
+}
+
+void Speed::SetPoolActive(size_t pool, bool active)
+{
+	std::lock_guard<std::mutex> lock(m_pools_mutex);
+	PoolStats& stats = *m_pools[pool];
+	if (stats.active == active)
+		return;
+	auto now = std::chrono::steady_clock::now();
+	if (stats.active)
+		stats.active_us += std::chrono::duration_cast<std::chrono::microseconds>(
+			now - stats.active_since).count();
+	stats.active = active;
+	stats.active_since = now;
+}
+
+void Speed::AddPoolHash(size_t pool)
+{
+	std::shared_ptr<PoolStats> stats = GetPool(pool);
+	if (stats)
+		stats->hashes.Add(CurrentSecond());
+}
+
+void Speed::AddPoolShare(size_t pool)
+{
+	std::shared_ptr<PoolStats> stats = GetPool(pool);
+	if (stats)
+		++stats->shares;
+}
+
+void Speed::AddPoolSwitch(int64_t latency_us)
 {
-	m_mutex_hashes.lock();
-	m_buffer_hashes.clear();
-	m_mutex_hashes.unlock();
+	m_pool_switch.Record(latency_us);
+}
 
-	m_mutex_solutions.lock();
-	m_buffer_solutions.clear();
-	m_mutex_solutions.unlock();
+size_t Speed::GetPoolCount()
+{
+	return m_pool_count.load(std::memory_order_acquire);
+}
 
-	m_mutex_shares.lock();
-	m_buffer_shares.clear();
-	m_mutex_shares.unlock();
+std::shared_ptr<PoolStats> Speed::GetPool(size_t pool)
+{
+	return pool < GetPoolCount() ? m_pools[pool] : nullptr;
+}
 
-	m_mutex_shares_ok.lock();
-	m_buffer_shares_ok.clear();
-	m_mutex_shares_ok.unlock();
+double Speed::GetPoolHashSpeed(PoolStats& pool, int window)
+{
+	return Get(pool.hashes, window);
+}
+
+double Speed::GetPoolSeconds(PoolStats& pool)
+{
+	std::lock_guard<std::mutex> lock(m_pools_mutex);
+	int64_t us = pool.active_us;
+	if (pool.active)
+		us += std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - pool.active_since).count();
+	return (double)us / 1000000;
+}
+
+double Speed::GetFirstHashLatency()
+{
+	return (double)m_first_hash_us.load() / 1000;
+}
+
+void Speed::SubmitQueued()
+{
+	++m_submit_queue;
+}
+
+void Speed::SubmitSent(int64_t latency_us)
+{
+	--m_submit_queue;
+	++m_submit_count;
+	m_submit_latency_total_us += latency_us;
+	int64_t max = m_submit_latency_max_us.load();
+	while (latency_us > max && !m_submit_latency_max_us.compare_exchange_weak(max, latency_us)) {}
+	m_submit_latency.Record(latency_us);
+}
+
+void Speed::SubmitDropped()
+{
+	--m_submit_queue;
+}
+
+int Speed::GetSubmitQueueDepth()
+{
+	return m_submit_queue.load();
+}
+
+double Speed::GetSubmitLatency()
+{
+	int64_t count = m_submit_count.load();
+	return count ? (double)m_submit_latency_total_us.load() / count / 1000 : 0;
+}
+
+double Speed::GetSubmitLatencyMax()
+{
+	return (double)m_submit_latency_max_us.load() / 1000;
+}
+
+void Speed::AddShareLatency(int64_t latency_us)
+{
+	m_share_latency.Record(latency_us);
+}
+
+void Speed::AddJobLatency(int64_t latency_us)
+{
+	m_job_latency.Record(latency_us);
+}
+
+void Speed::PrintHistograms(std::ostream& out)
+{
+	out << "# Solution found to submit written" << std::endl;
+	m_submit_latency.Print(out);
+	out << std::endl << "# Submit written to pool response" << std::endl;
+	m_share_latency.Print(out);
+	out << std::endl << "# Job received to first nonce started" << std::endl;
+	m_job_latency.Print(out);
+	out << std::endl << "# Active pool lost to standby mining" << std::endl;
+	m_pool_switch.Print(out);
+	for (size_t i = 0; i < GetSolverCount(); ++i)
+	{
+		std::shared_ptr<SolverStats> solver = GetSolver(i);
+		if (!solver)
+			continue;
+		out << std::endl << "# Solve time of solver #" << i << " " << solver->name
+			<< " " << solver->device << std::endl;
+		solver->solve_time.Print(out);
+	}
+}
+
+void Speed::Reset()
+{
+	m_hashes.Reset();
+	m_solutions.Reset();
+	m_shares.Reset();
+	m_shares_ok.Reset();
+	m_share_count = 0;
+	m_share_ok_count = 0;
+	m_share_rejected_count = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_solvers_mutex);
+		for (std::shared_ptr<SolverStats>& solver : m_solvers)
+			solver->Reset();
+	}
 
 	m_start = std::chrono::high_resolution_clock::now();
+	m_start_second = CurrentSecond();
+	m_first_hash_us = -1;
+	m_submit_count = 0;
+	m_submit_latency_total_us = 0;
+	m_submit_latency_max_us = 0;
+	m_submit_latency.Reset();
+	m_share_latency.Reset();
+	m_job_latency.Reset();
+	m_stale_shares = 0;
+	m_stale_accepted = 0;
+	m_stale_rejected = 0;
+	m_stale_runs = 0;
+	m_filtered_solutions = 0;
+	m_job_changes = 0;
+	m_wasted_us = 0;
+	m_pool_switch.Reset();
+	{
+		std::lock_guard<std::mutex> lock(m_pools_mutex);
+		for (size_t i = 0; i < GetPoolCount(); ++i)
+			m_pools[i]->Reset();
+	}
 }
 
 
@@ -1,7 +1,138 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
 #define INTERVAL_SECONDS 15 // 15 seconds
 
+// Windows reported next to the default interval
+#define SPEED_WINDOW_SHORT 10
+#define SPEED_WINDOW_MEDIUM 60
+#define SPEED_WINDOW_LONG 900
+
+// One-second slots kept per shard, a power of two above SPEED_WINDOW_LONG
+#define SPEED_SLOTS 1024
+#define SPEED_SHARDS 16
+
+// Pool connections tracked, each StratumClient adds its primary and standbys
+#define SPEED_MAX_POOLS 64
+
+/**
+ * Counts events in one-second slots of a ring buffer. Each writer thread
+ * sticks to one shard, so writers rarely share a cache line, and a slot
+ * packs its second and its count into one word updated by CAS. Readers sum
+ * the shards without blocking writers. Memory is fixed whatever the rate.
+ */
+class RateMeter
+{
+	struct Shard
+	{
+		// Second (high 32 bits) and count in that second (low 32 bits)
+		std::atomic<uint64_t> slots[SPEED_SLOTS];
+		char pad[64];
+	};
+
+	std::vector<Shard> m_shards;
+
+public:
+	explicit RateMeter(size_t shards = SPEED_SHARDS);
+
+	void Add(uint32_t second);
+	// Events per second over the completed seconds [now - window, now)
+	double Get(uint32_t now, uint32_t window);
+	void Reset();
+};
+
+// Histogram buckets per power of two, values below twice that are exact.
+// 7 bits keep every recorded value within 1/128 (under 1%).
+#define HIST_SUB_BUCKET_BITS 7
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BUCKET_BITS)
+// Larger values (about 12 days in microseconds) are recorded as the largest
+#define HIST_MAX_BITS 40
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BUCKET_BITS + 1) * HIST_SUB_BUCKETS)
+
+/**
+ * HdrHistogram-style latency histogram in microseconds. Buckets are
+ * linear within each power of two, so percentiles keep the same relative
+ * precision from microseconds to hours. Recording is a few relaxed atomic
+ * updates and never blocks, readers walk the buckets while writers run.
+ */
+class LatencyHistogram
+{
+	std::atomic<uint64_t> m_counts[HIST_BUCKETS];
+	std::atomic<uint64_t> m_total;
+	std::atomic<uint64_t> m_sum;
+	std::atomic<uint64_t> m_min;
+	std::atomic<uint64_t> m_max;
+
+	static size_t Index(uint64_t value);
+	// Largest value recorded into bucket index
+	static uint64_t HighestEquivalent(size_t index);
+
+public:
+	LatencyHistogram();
+
+	void Record(uint64_t us);
+	uint64_t Count() const;
+	uint64_t Sum() const;
+	uint64_t Min() const;
+	uint64_t Max() const;
+	double Mean() const;
+	// Smallest value at or above percent of the recorded values, 0 if empty
+	uint64_t Percentile(double percent) const;
+	// Fills out with the number of values at or below each of count
+	// ascending bounds, and returns the number of all values, in one walk
+	// over the buckets. A bound inside a bucket counts the bucket above it.
+	uint64_t Cumulative(const uint64_t* bounds, size_t count, uint64_t* out) const;
+	// Writes the percentile distribution, one "value percentile count" line
+	// per bucket in use, values in milliseconds
+	void Print(std::ostream& out) const;
+	void Reset();
+};
+
+// Counters of one solver, only written by its mining thread
+struct SolverStats
+{
+	std::string name;
+	std::string device;
+	RateMeter hashes;
+	RateMeter solutions;
+	std::atomic<uint64_t> hash_count;
+	std::atomic<uint64_t> solution_count;
+	std::atomic<uint64_t> shares;    // solutions that met the job target
+	std::atomic<uint64_t> wasted;    // runs cancelled by a job switch
+	std::atomic<uint64_t> wasted_ms; // time spent in those runs
+	std::atomic<uint64_t> memory;    // bytes a run allocates, 0 if unknown
+	std::atomic<bool> paused;        // through the API
+	LatencyHistogram solve_time;     // runs that were not cancelled
+
+	SolverStats(const std::string& name, const std::string& device);
+	void Reset();
+};
+
+// Counters of one pool connection, the time fields guarded by the Speed
+struct PoolStats
+{
+	std::string name;
+	size_t source;       // miner job source the connection feeds
+	unsigned int weight; // share of solver time of that source
+	RateMeter hashes;    // of jobs from this connection
+	std::atomic<uint64_t> shares;
+	std::atomic<bool> connected; // authorized on the pool
+	std::atomic<bool> active;
+	int64_t active_us;   // mined on, up to active_since
+	std::chrono::steady_clock::time_point active_since;
+
+	PoolStats(const std::string& name, size_t source, unsigned int weight);
+	void Reset();
+};
+
 class Speed
 {
 	int m_interval;
@@ -9,32 +140,134 @@ class Speed
 	using time_point = std::chrono::high_resolution_clock::time_point;
 
 	time_point m_start;
+	std::atomic<uint32_t> m_start_second;
+
+	RateMeter m_hashes;
+	RateMeter m_solutions;
+	RateMeter m_shares;
+	RateMeter m_shares_ok;
+	// Totals since start, for scrapers that compute their own rates
+	std::atomic<uint64_t> m_share_count;
+	std::atomic<uint64_t> m_share_ok_count;
+	std::atomic<uint64_t> m_share_rejected_count;
+
+	// Indexed by miner thread, grown only while no mining thread runs
+	std::vector<std::shared_ptr<SolverStats>> m_solvers;
+	std::mutex m_solvers_mutex;
+
+	// Microseconds from m_start to the first hash, -1 until then
+	std::atomic<int64_t> m_first_hash_us;
+
+	// Solutions waiting for the submit thread, and how long solutions took
+	// from being queued to being written to the socket
+	std::atomic<int> m_submit_queue;
+	std::atomic<int64_t> m_submit_count;
+	std::atomic<int64_t> m_submit_latency_total_us;
+	std::atomic<int64_t> m_submit_latency_max_us;
 
-	std::vector<time_point> m_buffer_hashes;
-	std::vector<time_point> m_buffer_solutions;
-	std::vector<time_point> m_buffer_shares;
-	std::vector<time_point> m_buffer_shares_ok;
+	LatencyHistogram m_submit_latency; // solution found to bytes written
+	LatencyHistogram m_share_latency;  // bytes written to pool response
+	LatencyHistogram m_job_latency;    // job received to first nonce started
 
-	std::mutex m_mutex_hashes;
-	std::mutex m_mutex_solutions;
-	std::mutex m_mutex_shares;
-	std::mutex m_mutex_shares_ok;
+	// Shares of replaced jobs and what the pool made of them
+	std::atomic<uint64_t> m_stale_shares;
+	std::atomic<uint64_t> m_stale_accepted;
+	std::atomic<uint64_t> m_stale_rejected;
+	// Runs finished after their job was replaced
+	std::atomic<uint64_t> m_stale_runs;
+	// Solutions above the share target, dropped before submitting
+	std::atomic<uint64_t> m_filtered_solutions;
+	// Clean jobs replacing a job, and solver time lost to aborted runs
+	std::atomic<uint64_t> m_job_changes;
+	std::atomic<uint64_t> m_wasted_us;
 
-	void Add(std::vector<time_point>& buffer, std::mutex& mutex);
-	double Get(std::vector<time_point>& buffer, std::mutex& mutex);
+	// Pool connections in the order they were added, and how long solvers
+	// waited for a standby when an active pool was lost. Slots below
+	// m_pool_count are never replaced, so mining threads and the API read
+	// them without the mutex, which guards adding and the time fields.
+	std::shared_ptr<PoolStats> m_pools[SPEED_MAX_POOLS];
+	std::atomic<size_t> m_pool_count;
+	std::mutex m_pools_mutex;
+	LatencyHistogram m_pool_switch;
+
+	double Get(RateMeter& meter, int window);
 
 public:
 	Speed(int interval);
 	virtual ~Speed();
 
-	void AddHash();
-	void AddSolution();
+	// Called before the mining threads start, names solver pos
+	void InitSolver(size_t pos, const std::string& name, const std::string& device);
+	size_t GetSolverCount();
+	std::shared_ptr<SolverStats> GetSolver(size_t pos);
+	double GetSolverHashSpeed(SolverStats& solver, int window = 0);
+	double GetSolverSolutionSpeed(SolverStats& solver, int window = 0);
+
+	void AddHash(size_t solver);
+	void AddSolution(size_t solver);
+	void AddSolverShare(size_t solver);
+	// Records one solver run, cancelled runs count as wasted
+	void AddSolveTime(size_t solver, double seconds, bool cancelled);
+	void SetSolverMemory(size_t solver, uint64_t bytes);
+	void SetSolverPaused(size_t solver, bool paused);
 	void AddShare();
 	void AddShareOK();
-	double GetHashSpeed();
-	double GetSolutionSpeed();
-	double GetShareSpeed();
-	double GetShareOKSpeed();
+	void AddShareRejected();
+	uint64_t GetShareCount() { return m_share_count; }
+	uint64_t GetShareOKCount() { return m_share_ok_count; }
+	uint64_t GetShareRejectedCount() { return m_share_rejected_count; }
+	void AddStaleShare();
+	void StaleShareAnswered(bool accepted);
+	void AddStaleRun();
+	void AddJobChange();
+	void AddFilteredSolution();
+	uint64_t GetStaleShares() { return m_stale_shares; }
+	uint64_t GetStaleAccepted() { return m_stale_accepted; }
+	uint64_t GetStaleRejected() { return m_stale_rejected; }
+	uint64_t GetStaleRuns() { return m_stale_runs; }
+	uint64_t GetJobChanges() { return m_job_changes; }
+	uint64_t GetFilteredSolutions() { return m_filtered_solutions; }
+	// Solver-seconds of aborted runs, in all and per job change
+	double GetWastedSeconds();
+	double GetWastedPerJobChange();
+	// Rates per second, over the interval given at construction by default
+	double GetHashSpeed(int window = 0);
+	double GetSolutionSpeed(int window = 0);
+	double GetShareSpeed(int window = 0);
+	double GetShareOKSpeed(int window = 0);
+	// Milliseconds from start (or Reset) to the first hash, negative if none yet
+	double GetFirstHashLatency();
+
+	void SubmitQueued();
+	void SubmitSent(int64_t latency_us);
+	// Leaves the queue without being written
+	void SubmitDropped();
+	int GetSubmitQueueDepth();
+	// Average and worst queue-to-wire latency in milliseconds
+	double GetSubmitLatency();
+	double GetSubmitLatencyMax();
+
+	void AddShareLatency(int64_t latency_us);
+	void AddJobLatency(int64_t latency_us);
+	LatencyHistogram& GetSubmitLatencyHistogram() { return m_submit_latency; }
+	LatencyHistogram& GetShareLatencyHistogram() { return m_share_latency; }
+	LatencyHistogram& GetJobLatencyHistogram() { return m_job_latency; }
+	// Returns the index of a new pool connection, throws std::length_error
+	// past SPEED_MAX_POOLS
+	size_t AddPool(const std::string& name, size_t source, unsigned int weight);
+	void SetPoolConnected(size_t pool, bool connected);
+	void SetPoolActive(size_t pool, bool active);
+	void AddPoolHash(size_t pool);
+	void AddPoolShare(size_t pool);
+	void AddPoolSwitch(int64_t latency_us);
+	size_t GetPoolCount();
+	std::shared_ptr<PoolStats> GetPool(size_t pool);
+	double GetPoolHashSpeed(PoolStats& pool, int window = 0);
+	// Seconds spent mining on the pool
+	double GetPoolSeconds(PoolStats& pool);
+	LatencyHistogram& GetPoolSwitchHistogram() { return m_pool_switch; }
+	// Writes every histogram, solvers included, in text form
+	void PrintHistograms(std::ostream& out);
 
 	void Reset();
 };
@@ -0,0 +1,137 @@
+/*
+   Two-lane BLAKE2b finalisation for Equihash leaf hashing.
+
+   Modified Aion Foundation 2017-2018
+
+   Based on the BLAKE2 reference source code package written in 2012 by
+   Samuel Neves <sneves@dei.uc.pt>, dedicated to the public domain under
+   the CC0 Public Domain Dedication.
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "blake2.h"
+#include "blake2-impl.h"
+#include "blake2b-lanes.h"
+
+#include <emmintrin.h>
+
+static const uint64_t blake2b_IV[8] =
+{
+  0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL,
+  0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+  0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+  0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+};
+
+static const uint8_t blake2b_sigma[12][16] =
+{
+  {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 } ,
+  { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 } ,
+  { 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 } ,
+  {  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 } ,
+  {  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 } ,
+  {  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 } ,
+  { 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 } ,
+  { 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 } ,
+  {  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 } ,
+  { 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13 , 0 } ,
+  {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 } ,
+  { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 }
+};
+
+/* Lane 0 lives in the low quadword, lane 1 in the high quadword */
+#define ROTR64X2(x, c) \
+  _mm_or_si128( _mm_srli_epi64( (x), (c) ), _mm_slli_epi64( (x), 64 - (c) ) )
+
+#define GX2(r,i,a,b,c,d) \
+  do { \
+    a = _mm_add_epi64( _mm_add_epi64( a, b ), m[blake2b_sigma[r][2*i+0]] ); \
+    d = _mm_shuffle_epi32( _mm_xor_si128( d, a ), _MM_SHUFFLE(2,3,0,1) ); \
+    c = _mm_add_epi64( c, d ); \
+    b = ROTR64X2( _mm_xor_si128( b, c ), 24 ); \
+    a = _mm_add_epi64( _mm_add_epi64( a, b ), m[blake2b_sigma[r][2*i+1]] ); \
+    d = ROTR64X2( _mm_xor_si128( d, a ), 16 ); \
+    c = _mm_add_epi64( c, d ); \
+    b = ROTR64X2( _mm_xor_si128( b, c ), 63 ); \
+  } while(0)
+
+#define ROUNDX2(r) \
+  do { \
+    GX2(r,0,v[ 0],v[ 4],v[ 8],v[12]); \
+    GX2(r,1,v[ 1],v[ 5],v[ 9],v[13]); \
+    GX2(r,2,v[ 2],v[ 6],v[10],v[14]); \
+    GX2(r,3,v[ 3],v[ 7],v[11],v[15]); \
+    GX2(r,4,v[ 0],v[ 5],v[10],v[15]); \
+    GX2(r,5,v[ 1],v[ 6],v[11],v[12]); \
+    GX2(r,6,v[ 2],v[ 7],v[ 8],v[13]); \
+    GX2(r,7,v[ 3],v[ 4],v[ 9],v[14]); \
+  } while(0)
+
+int blake2b_final_x2( const blake2b_state *S0, const blake2b_state *S1,
+                      uint8_t *out0, uint8_t *out1, uint8_t outlen )
+{
+  if( outlen > BLAKE2B_OUTBYTES )
+    return -1;
+
+  if( S0->buflen > BLAKE2B_BLOCKBYTES || S1->buflen > BLAKE2B_BLOCKBYTES )
+    return -1;
+
+  uint8_t block0[BLAKE2B_BLOCKBYTES];
+  uint8_t block1[BLAKE2B_BLOCKBYTES];
+  memcpy( block0, S0->buf, S0->buflen );
+  memset( block0 + S0->buflen, 0, BLAKE2B_BLOCKBYTES - S0->buflen ); /* Padding */
+  memcpy( block1, S1->buf, S1->buflen );
+  memset( block1 + S1->buflen, 0, BLAKE2B_BLOCKBYTES - S1->buflen ); /* Padding */
+
+  __m128i m[16];
+  __m128i h[8];
+  __m128i v[16];
+
+  for( int i = 0; i < 16; ++i )
+    m[i] = _mm_set_epi64x( ( int64_t )load64( block1 + i * 8 ),
+                           ( int64_t )load64( block0 + i * 8 ) );
+
+  for( int i = 0; i < 8; ++i )
+  {
+    h[i] = _mm_set_epi64x( ( int64_t )S1->h[i], ( int64_t )S0->h[i] );
+    v[i] = h[i];
+    v[i + 8] = _mm_set1_epi64x( ( int64_t )blake2b_IV[i] );
+  }
+
+  /* Counter of the final block; lastblock flag is set in both lanes */
+  const uint64_t t0 = ( uint16_t )( S0->counter + S0->buflen );
+  const uint64_t t1 = ( uint16_t )( S1->counter + S1->buflen );
+  v[12] = _mm_xor_si128( v[12], _mm_set_epi64x( ( int64_t )t1, ( int64_t )t0 ) );
+  v[14] = _mm_xor_si128( v[14], _mm_set1_epi64x( -1 ) );
+
+  ROUNDX2( 0 );
+  ROUNDX2( 1 );
+  ROUNDX2( 2 );
+  ROUNDX2( 3 );
+  ROUNDX2( 4 );
+  ROUNDX2( 5 );
+  ROUNDX2( 6 );
+  ROUNDX2( 7 );
+  ROUNDX2( 8 );
+  ROUNDX2( 9 );
+  ROUNDX2( 10 );
+  ROUNDX2( 11 );
+
+  ALIGN( 16 ) uint64_t lanes[2];
+  uint8_t digest0[BLAKE2B_OUTBYTES];
+  uint8_t digest1[BLAKE2B_OUTBYTES];
+
+  for( int i = 0; i < 8; ++i )
+  {
+    h[i] = _mm_xor_si128( h[i], _mm_xor_si128( v[i], v[i + 8] ) );
+    _mm_store_si128( ( __m128i * )lanes, h[i] );
+    store64( digest0 + i * 8, lanes[0] );
+    store64( digest1 + i * 8, lanes[1] );
+  }
+
+  memcpy( out0, digest0, outlen );
+  memcpy( out1, digest1, outlen );
+  return 0;
+}
@@ -0,0 +1,31 @@
+/*
+   Two-lane BLAKE2b finalisation for Equihash leaf hashing.
+
+   Modified Aion Foundation 2017-2018
+
+   Every Equihash leaf is a single BLAKE2b block: the personalised state,
+   the 64 byte header (header hash + nonce) and a 4 byte index. Two such
+   blocks are independent, so they are compressed side by side, one per
+   64-bit lane of an SSE2 register.
+*/
+#pragma once
+#ifndef __BLAKE2B_LANES_H__
+#define __BLAKE2B_LANES_H__
+
+#include "blake2.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+  /* Finalises S0 and S1 together. Both states must hold at most one
+     pending block (buflen <= BLAKE2B_BLOCKBYTES), which is always the
+     case for Equihash leaves. The states are left untouched. */
+  int blake2b_final_x2( const blake2b_state *S0, const blake2b_state *S1,
+                        uint8_t *out0, uint8_t *out1, uint8_t outlen );
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
@@ -17,11 +17,12 @@ void CPU_TROMP::solve(const char *tequihash_header,
 		unsigned int tequihash_header_len, const char* nonce,
 		unsigned int nonce_len, std::function<bool()> cancelf,
 		std::function<
-				void(const std::vector<uint32_t>&, size_t, const unsigned char*)> solutionf,
+				void(const uint32_t*, size_t, const unsigned char*)> solutionf,
 		std::function<void(void)> hashdonef,
 		CPU_TROMP& device_context) {
 
 	equi eq(1, tequihash_header_len, nonce_len);
+	device_context.memory.store(eq.hta.alloced, std::memory_order_relaxed);
 	eq.setnonce(tequihash_header, tequihash_header_len, nonce, nonce_len);
 	eq.digit0(0);
 	eq.bfull = eq.hfull = 0;
@@ -84,11 +85,7 @@ void CPU_TROMP::solve(const char *tequihash_header,
 		return;
 
 	for (unsigned s = 0; s < eq.nsols; s++) {
-		std::vector<uint32_t> index_vector(PROOFSIZE);
-		for (u32 i = 0; i < PROOFSIZE; i++) {
-			index_vector[i] = eq.sols[s][i];
-		}
-		solutionf(index_vector, DIGITBITS, nullptr);
+		solutionf(eq.sols[s], DIGITBITS, nullptr);
 		if (cancelf())
 			return;
 	}
@@ -1,3 +1,5 @@
+#include <atomic>
+#include <cstdint>
 
 #define CPU_TROMP cpu_tromp
 #if defined(__AVX__)
@@ -7,6 +9,8 @@
 #endif
 
 struct CPU_TROMP {
+	CPU_TROMP() : use_opt(0), memory(0) {}
+
 	std::string getdevinfo() {
 		return "";
 	}
@@ -21,7 +25,7 @@ struct CPU_TROMP {
 			unsigned int tequihash_header_len, const char* nonce,
 			unsigned int nonce_len, std::function<bool()> cancelf,
 			std::function<
-					void(const std::vector<uint32_t>&, size_t,
+					void(const uint32_t*, size_t,
 							const unsigned char*)> solutionf,
 			std::function<void(void)> hashdonef,
 			CPU_TROMP& device_context);
@@ -31,5 +35,7 @@ struct CPU_TROMP {
 	}
 
 	int use_opt;
+	// Bytes the last run allocated, read by other threads
+	std::atomic<uint64_t> memory;
 };
 
@@ -99,44 +99,6 @@ void setheader(blake2b_state *ctx, const char *header, const u32 headerLen, cons
   // printf("\n\n");
 }
 
-enum verify_code { POW_OK, POW_DUPLICATE, POW_OUT_OF_ORDER, POW_NONZERO_XOR };
-const char *errstr[] = { "OK", "duplicate index", "indices out of order", "nonzero xor" };
-
-void genhash(blake2b_state *ctx, u32 idx, uchar *hash) {
-  blake2b_state state = *ctx;
-  u32 leb = (idx / HASHESPERBLAKE);
-  blake2b_update(&state, (uchar *)&leb, sizeof(u32));
-  uchar blakehash[HASHOUT];
-  blake2b_final(&state, blakehash, HASHOUT);
-  memcpy(hash, blakehash + (idx % HASHESPERBLAKE) * HASHLEN, HASHLEN);
-}
-
-int verifyrec(blake2b_state *ctx, u32 *indices, uchar *hash, int r) {
-  if (r == 0) {
-    genhash(ctx, *indices, hash);
-    return POW_OK;
-  }
-  u32 *indices1 = indices + (1 << (r-1));
-  if (*indices >= *indices1)
-    return POW_OUT_OF_ORDER;
-  uchar hash0[HASHLEN], hash1[HASHLEN];
-  int vrf0 = verifyrec(ctx, indices,  hash0, r-1);
-  if (vrf0 != POW_OK)
-    return vrf0;
-  int vrf1 = verifyrec(ctx, indices1, hash1, r-1);
-  if (vrf1 != POW_OK)
-    return vrf1;
-  for (int i=0; i < HASHLEN; i++)
-    hash[i] = hash0[i] ^ hash1[i];
-  int i, b = r * DIGITBITS;
-  for (i = 0; i < b/8; i++)
-    if (hash[i])
-      return POW_NONZERO_XOR;
-  if ((b%8) && hash[i] >> (8-(b%8)))
-    return POW_NONZERO_XOR;
-  return POW_OK;
-}
-
 int compu32(const void *pa, const void *pb) {
   u32 a = *(u32 *)pa, b = *(u32 *)pb;
   return a<b ? -1 : a==b ? 0 : +1;
@@ -152,13 +114,5 @@ bool duped(proof prf) {
   return false;
 }
 
-// verify Wagner conditions
-int verify(u32 indices[PROOFSIZE], const char *header, const u32 headerlen, const char *nonce, u32 noncelen) {
-  if (duped(indices))
-    return POW_DUPLICATE;
-  blake2b_state ctx;
-  setheader(&ctx, header, headerlen, nonce, noncelen);
-  uchar hash[WN/8];
-  return verifyrec(&ctx, indices, hash, WK);
-}
+// solutions are verified by the equiverify library
 
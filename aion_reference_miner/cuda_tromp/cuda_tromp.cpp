@@ -68,7 +68,7 @@ void SOLVER_NAME::solve(const char *tequihash_header,
 	const char* nonce,
 	unsigned int nonce_len,
 	std::function<bool()> cancelf,
-	std::function<void(const std::vector<uint32_t>&, size_t, const unsigned char*)> solutionf,
+	std::function<void(const uint32_t*, size_t, const unsigned char*)> solutionf,
 	std::function<void(void)> hashdonef,
 	SOLVER_NAME& device_context)
 {
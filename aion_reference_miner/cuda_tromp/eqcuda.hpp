@@ -41,6 +41,6 @@ struct eq_cuda_context
 		const char* nonce,
 		unsigned int nonce_len,
 		std::function<bool()> cancelf,
-		std::function<void(const std::vector<uint32_t>&, size_t, const unsigned char*)> solutionf,
+		std::function<void(const uint32_t*, size_t, const unsigned char*)> solutionf,
 		std::function<void(void)> hashdonef);
 };
@@ -1107,7 +1107,7 @@ void eq_cuda_context::solve(const char *tequihash_header,
 	const char* nonce,
 	unsigned int nonce_len,
 	std::function<bool()> cancelf,
-	std::function<void(const std::vector<uint32_t>&, size_t, const unsigned char*)> solutionf,
+	std::function<void(const uint32_t*, size_t, const unsigned char*)> solutionf,
 	std::function<void(void)> hashdonef)
 {
 	checkCudaErrors(cudaSetDevice(device_id));
@@ -1188,12 +1188,7 @@ void eq_cuda_context::solve(const char *tequihash_header,
 
 	for (unsigned s = 0; (s < eq->nsols) && (s < MAXSOLS); s++)
 	{
-		std::vector<uint32_t> index_vector(PROOFSIZE);
-		for (u32 i = 0; i < PROOFSIZE; i++) {
-			index_vector[i] = solutions[s][i];
-		}
-
-		solutionf(index_vector, DIGITBITS, nullptr);
+		solutionf(solutions[s], DIGITBITS, nullptr);
 		if (cancelf()) return;
 	}
 	hashdonef();
@@ -0,0 +1,168 @@
+// Copyright (c) 2018 Aion Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Verifies shares read from a file or stdin and measures verifications per
+// second over a number of threads.
+//
+// Input is one share per line: the header (header hash + nonce) and the
+// solution as hex, separated by whitespace. A leading "fd8005" size prefix
+// on the solution, as sent in mining.submit, is ignored.
+
+#include "equiverify.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Share {
+	std::vector<unsigned char> header;
+	std::vector<unsigned char> solution;
+};
+
+static bool ParseHex(const std::string& hex, std::vector<unsigned char>& out) {
+	if (hex.size() % 2)
+		return false;
+	out.resize(hex.size() / 2);
+	for (size_t i = 0; i < out.size(); i++) {
+		char byte[3] = { hex[2 * i], hex[2 * i + 1], 0 };
+		char *end;
+		out[i] = (unsigned char) strtoul(byte, &end, 16);
+		if (*end)
+			return false;
+	}
+	return true;
+}
+
+static bool ReadShares(std::istream& in, std::vector<Share>& shares) {
+	std::string line;
+	size_t lineNo = 0;
+	while (std::getline(in, line)) {
+		lineNo++;
+		std::istringstream fields(line);
+		std::string header, solution;
+		if (!(fields >> header))
+			continue;
+		if (header[0] == '#')
+			continue;
+		fields >> solution;
+		if (solution.size() == 2 * EQUIVERIFY_SOLUTION_BYTES + 6
+				&& solution.compare(0, 6, "fd8005") == 0)
+			solution.erase(0, 6);
+
+		Share share;
+		if (!ParseHex(header, share.header) || !ParseHex(solution, share.solution)) {
+			std::cerr << "line " << lineNo << ": invalid hex" << std::endl;
+			return false;
+		}
+		shares.push_back(share);
+	}
+	return true;
+}
+
+static void Usage(const char *name) {
+	std::cerr << "usage: " << name << " [-t threads] [-s seconds] [file]" << std::endl
+			<< "  reads shares from file, or stdin when no file or '-' is given" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+	unsigned int threads = std::thread::hardware_concurrency();
+	double seconds = 10;
+	const char *path = "-";
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-t") && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+			seconds = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+			Usage(argv[0]);
+			return 0;
+		} else
+			path = argv[i];
+	}
+	if (threads == 0)
+		threads = 1;
+
+	std::vector<Share> shares;
+	bool ok;
+	if (!strcmp(path, "-")) {
+		ok = ReadShares(std::cin, shares);
+	} else {
+		std::ifstream file(path);
+		if (!file) {
+			std::cerr << "cannot open " << path << std::endl;
+			return 1;
+		}
+		ok = ReadShares(file, shares);
+	}
+	if (!ok)
+		return 1;
+	if (shares.empty()) {
+		std::cerr << "no shares to verify" << std::endl;
+		Usage(argv[0]);
+		return 1;
+	}
+
+	if (equiverify_init() != 0) {
+		std::cerr << "equiverify_init failed" << std::endl;
+		return 1;
+	}
+
+	std::vector<equiverify_share> batch(shares.size());
+	for (size_t i = 0; i < shares.size(); i++) {
+		batch[i].header = shares[i].header.data();
+		batch[i].header_len = shares[i].header.size();
+		batch[i].solution = shares[i].solution.data();
+		batch[i].solution_len = shares[i].solution.size();
+	}
+
+	std::vector<int> results(batch.size());
+	size_t valid = equiverify_verify_many(batch.data(), batch.size(), results.data());
+	for (size_t i = 0; i < results.size(); i++) {
+		if (results[i] != EQUIVERIFY_OK)
+			std::cout << "share " << i << ": " << equiverify_strerror(results[i]) << std::endl;
+	}
+	std::cout << valid << " of " << batch.size() << " shares valid" << std::endl;
+
+	// Every thread walks the share list from its own offset until time is up
+	std::atomic<bool> stop(false);
+	std::vector<uint64_t> counts(threads, 0);
+	std::vector<std::thread> workers;
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned int t = 0; t < threads; t++) {
+		workers.emplace_back([&, t]() {
+			size_t i = t % batch.size();
+			uint64_t done = 0;
+			while (!stop.load(std::memory_order_relaxed)) {
+				equiverify_verify(batch[i].header, batch[i].header_len,
+						batch[i].solution, batch[i].solution_len);
+				done++;
+				if (++i == batch.size())
+					i = 0;
+			}
+			counts[t] = done;
+		});
+	}
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+	stop = true;
+	for (std::thread& worker : workers)
+		worker.join();
+	double elapsed = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - start).count();
+
+	uint64_t total = 0;
+	for (uint64_t count : counts)
+		total += count;
+	std::cout << threads << " threads: " << total << " verifications in "
+			<< elapsed << " s, " << (uint64_t) (total / elapsed) << " verifications/s, "
+			<< (uint64_t) (total / elapsed / threads) << " per thread" << std::endl;
+	return 0;
+}
@@ -0,0 +1,208 @@
+// Copyright (c) 2018 Aion Foundation
+// Copyright (c) 2016 Jack Grigg
+// Copyright (c) 2016-2016 John Tromp
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "equiverify.h"
+
+#include "../blake2/blake2.h"
+#include "../blake2/blake2b-lanes.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+typedef uint32_t eh_index;
+
+namespace {
+
+const unsigned int N = EQUIVERIFY_N;
+const unsigned int K = EQUIVERIFY_K;
+const size_t IndicesPerHashOutput = 512 / N;
+const size_t HashLen = (N + 7) / 8;
+const size_t HashOutput = IndicesPerHashOutput * HashLen;
+const size_t CollisionBitLength = N / (K + 1);
+const size_t ProofSize = 1 << K;
+
+static_assert(ProofSize * (CollisionBitLength + 1) / 8 == EQUIVERIFY_SOLUTION_BYTES,
+		"solution size does not match the Equihash parameters");
+
+blake2b_state MakeBaseState() {
+	unsigned char personalization[BLAKE2B_PERSONALBYTES] = {};
+	memcpy(personalization, "AION0PoW", 8);
+	// N and K as little-endian 32-bit values
+	for (int i = 0; i < 4; i++) {
+		personalization[8 + i] = (N >> (8 * i)) & 0xff;
+		personalization[12 + i] = (K >> (8 * i)) & 0xff;
+	}
+
+	blake2b_param P[1];
+	memset(P, 0, sizeof(P));
+	P->digest_length = HashOutput;
+	P->fanout = 1;
+	P->depth = 1;
+	memcpy(P->personal, personalization, BLAKE2B_PERSONALBYTES);
+
+	blake2b_state state;
+	blake2b_init_param(&state, P);
+	return state;
+}
+
+// Function-local static, so concurrent first calls are safe
+const blake2b_state& BaseState() {
+	static const blake2b_state state = MakeBaseState();
+	return state;
+}
+
+// The minimal solution is a big-endian bit string of (CollisionBitLength + 1)
+// bit indices
+void ExpandIndices(const unsigned char *solution, eh_index *indices) {
+	const size_t bits = CollisionBitLength + 1;
+	const uint32_t mask = ((uint32_t) 1 << bits) - 1;
+	uint32_t acc = 0;
+	size_t accBits = 0;
+	size_t j = 0;
+	for (size_t i = 0; i < EQUIVERIFY_SOLUTION_BYTES; i++) {
+		acc = (acc << 8) | solution[i];
+		accBits += 8;
+		if (accBits >= bits) {
+			accBits -= bits;
+			indices[j++] = (acc >> accBits) & mask;
+		}
+	}
+}
+
+void LeafHashes(const blake2b_state *state, eh_index i0, eh_index i1,
+		unsigned char *hash0, unsigned char *hash1) {
+	// Both leaves are single BLAKE2b blocks, finalise them side by side
+	blake2b_state lane[2] = { *state, *state };
+	const eh_index block[2] = { i0 / (eh_index) IndicesPerHashOutput,
+			i1 / (eh_index) IndicesPerHashOutput };
+	for (int l = 0; l < 2; l++) {
+		unsigned char le[4];
+		for (int b = 0; b < 4; b++)
+			le[b] = (block[l] >> (8 * b)) & 0xff;
+		blake2b_update(&lane[l], le, sizeof(le));
+	}
+
+	unsigned char out0[HashOutput];
+	unsigned char out1[HashOutput];
+	blake2b_final_x2(&lane[0], &lane[1], out0, out1, HashOutput);
+	memcpy(hash0, out0 + (i0 % IndicesPerHashOutput) * HashLen, HashLen);
+	memcpy(hash1, out1 + (i1 % IndicesPerHashOutput) * HashLen, HashLen);
+}
+
+// Checks the subtree of height r rooted at indices and returns its XOR in hash
+int VerifySubtree(const blake2b_state *state, const eh_index *indices,
+		unsigned char *hash, unsigned int r) {
+	const eh_index *indices1 = indices + (1 << (r - 1));
+	if (indices[0] >= indices1[0])
+		return EQUIVERIFY_OUT_OF_ORDER;
+
+	unsigned char hash0[HashLen];
+	unsigned char hash1[HashLen];
+	if (r == 1) {
+		LeafHashes(state, indices[0], indices1[0], hash0, hash1);
+	} else {
+		int code = VerifySubtree(state, indices, hash0, r - 1);
+		if (code != EQUIVERIFY_OK)
+			return code;
+		code = VerifySubtree(state, indices1, hash1, r - 1);
+		if (code != EQUIVERIFY_OK)
+			return code;
+	}
+
+	for (size_t i = 0; i < HashLen; i++)
+		hash[i] = hash0[i] ^ hash1[i];
+
+	// r collision digits must be zero, and the whole hash at the root
+	const size_t bits = r < K ? r * CollisionBitLength : N;
+	size_t i = 0;
+	for (; i < bits / 8; i++) {
+		if (hash[i] != 0)
+			return EQUIVERIFY_NONZERO_XOR;
+	}
+	if ((bits % 8) && (hash[i] >> (8 - (bits % 8))))
+		return EQUIVERIFY_NONZERO_XOR;
+	return EQUIVERIFY_OK;
+}
+
+// state holds the personalised BLAKE2b state with the header absorbed
+int VerifySolution(const blake2b_state *state, const unsigned char *solution,
+		size_t solution_len) {
+	if (solution_len != EQUIVERIFY_SOLUTION_BYTES)
+		return EQUIVERIFY_BAD_LENGTH;
+
+	eh_index indices[ProofSize];
+	eh_index sorted[ProofSize];
+	ExpandIndices(solution, indices);
+
+	// Distinct indices across the whole tree is the same as every pair of
+	// subtrees being disjoint
+	std::copy(indices, indices + ProofSize, sorted);
+	std::sort(sorted, sorted + ProofSize);
+	if (std::adjacent_find(sorted, sorted + ProofSize) != sorted + ProofSize)
+		return EQUIVERIFY_DUPLICATE;
+
+	unsigned char hash[HashLen];
+	return VerifySubtree(state, indices, hash, K);
+}
+
+}
+
+int equiverify_init(void) {
+	BaseState();
+	return 0;
+}
+
+int equiverify_verify(const unsigned char *header, size_t header_len,
+		const unsigned char *solution, size_t solution_len) {
+	blake2b_state state = BaseState();
+	blake2b_update(&state, header, header_len);
+	return VerifySolution(&state, solution, solution_len);
+}
+
+size_t equiverify_verify_many(const equiverify_share *shares, size_t count,
+		int *results) {
+	// Shares of one job differ only in the trailing nonce, so a run of them
+	// absorbs the rest of the header into one state and copies it per share
+	blake2b_state group = BaseState();
+	const equiverify_share *leader = NULL;
+	size_t valid = 0;
+	for (size_t i = 0; i < count; i++) {
+		const equiverify_share &share = shares[i];
+		size_t prefix = share.header_len > EQUIVERIFY_NONCE_BYTES ?
+				share.header_len - EQUIVERIFY_NONCE_BYTES : 0;
+		if (!leader || leader->header_len != share.header_len
+				|| memcmp(leader->header, share.header, prefix) != 0) {
+			group = BaseState();
+			blake2b_update(&group, share.header, prefix);
+			leader = &share;
+		}
+		blake2b_state state = group;
+		blake2b_update(&state, share.header + prefix, share.header_len - prefix);
+		// Leaf pairs of every share are finalised in the two BLAKE2b lanes
+		results[i] = VerifySolution(&state, share.solution, share.solution_len);
+		if (results[i] == EQUIVERIFY_OK)
+			valid++;
+	}
+	return valid;
+}
+
+const char *equiverify_strerror(int code) {
+	switch (code) {
+	case EQUIVERIFY_OK:
+		return "OK";
+	case EQUIVERIFY_BAD_LENGTH:
+		return "wrong solution length";
+	case EQUIVERIFY_DUPLICATE:
+		return "duplicate index";
+	case EQUIVERIFY_OUT_OF_ORDER:
+		return "indices out of order";
+	case EQUIVERIFY_NONZERO_XOR:
+		return "nonzero xor";
+	default:
+		return "unknown error";
+	}
+}
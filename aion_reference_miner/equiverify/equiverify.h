@@ -0,0 +1,63 @@
+// Copyright (c) 2018 Aion Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Standalone Equihash 210,9 verifier with a C API.
+//
+// A share is the BLAKE2b input that precedes the index (for Aion the 32 byte
+// header hash followed by the 32 byte nonce) and the 1408 byte minimal
+// solution. Verification does not allocate and is safe to call from any
+// number of threads once equiverify_init has returned.
+
+#ifndef __EQUIVERIFY_H__
+#define __EQUIVERIFY_H__
+
+#include <stddef.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define EQUIVERIFY_N 210
+#define EQUIVERIFY_K 9
+#define EQUIVERIFY_SOLUTION_BYTES 1408
+// Trailing header bytes that vary between shares of one job
+#define EQUIVERIFY_NONCE_BYTES 32
+
+enum equiverify_code {
+	EQUIVERIFY_OK = 0,
+	EQUIVERIFY_BAD_LENGTH,
+	EQUIVERIFY_DUPLICATE,
+	EQUIVERIFY_OUT_OF_ORDER,
+	EQUIVERIFY_NONZERO_XOR
+};
+
+typedef struct equiverify_share {
+	const unsigned char *header;
+	size_t header_len;
+	const unsigned char *solution;
+	size_t solution_len;
+} equiverify_share;
+
+// Prepares the personalised BLAKE2b state. Returns 0 on success.
+int equiverify_init(void);
+
+// Returns EQUIVERIFY_OK or the first rule the solution breaks.
+int equiverify_verify(const unsigned char *header, size_t header_len,
+		const unsigned char *solution, size_t solution_len);
+
+// Verifies count shares, writing one equiverify_code per share to results.
+// Returns the number of valid shares. Consecutive shares whose headers only
+// differ in the last EQUIVERIFY_NONCE_BYTES share the BLAKE2b setup, so
+// callers should keep shares of one job together. The Equihash check itself
+// costs the same as equiverify_verify per share.
+size_t equiverify_verify_many(const equiverify_share *shares, size_t count,
+		int *results);
+
+const char *equiverify_strerror(int code);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
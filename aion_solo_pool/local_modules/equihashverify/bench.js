@@ -0,0 +1,62 @@
+#!/usr/bin/env nodejs
+// Pool-side share validation throughput: the JS chain processShare used to
+// run (concat, two blake2 hashes, bignum compare, verify) against the native
+// validateShare pipeline. Usage: node bench.js [shares]
+var ev = require('bindings')('equihashverify.node');
+var blake2 = require('blake2');
+var bignum = require('bignum');
+var vectors = require('./vectors.js');
+
+var shares = parseInt(process.argv[2]) || 2000;
+
+var headerHex = vectors.header.slice(0, 64);
+var nonceHex = vectors.header.slice(64);
+var solnHex = 'fd4005' + vectors.solution;
+
+var targetHex = 'ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff';
+var target = bignum(targetHex, 16);
+var targetBuffer = new Buffer(targetHex, 'hex');
+var headerHashBuffer = new Buffer(headerHex, 'hex');
+
+function blake2b32(input){
+    var h = blake2.createHash('blake2b', {digestLength: 32});
+    h.update(input);
+    return h.digest();
+}
+
+function jsPipeline(){
+    var header = new Buffer(64);
+    header.write(headerHex, 0, 32, 'hex');
+    header.write(nonceHex, 32, 32, 'hex');
+    var headerSoln = Buffer.concat([header, new Buffer(solnHex.slice(6), 'hex')]);
+    var headerHash = blake2b32(headerSoln);
+    bignum.fromBuffer(headerHash, {endian: 'big', size: 32}).toNumber();
+    if (ev.verify(header, new Buffer(solnHex.slice(6), 'hex')) !== true)
+        return false;
+    var complete = Buffer.alloc(1472);
+    complete.write(headerHex, 0, 32, 'hex');
+    complete.write(nonceHex, 32, 32, 'hex');
+    complete.write(solnHex.slice(6), 64, 1408, 'hex');
+    return !bignum.fromBuffer(blake2b32(complete), {endian: 'big', size: 32}).gt(target);
+}
+
+function nativePipeline(){
+    var check = ev.validateShare(headerHashBuffer, new Buffer(nonceHex, 'hex'),
+        new Buffer(solnHex.slice(6), 'hex'), targetBuffer);
+    return check.valid;
+}
+
+function run(name, fn){
+    var start = process.hrtime();
+    for (var i = 0; i < shares; i++){
+        if (!fn())
+            throw new Error(name + ' rejected a valid share');
+    }
+    var elapsed = process.hrtime(start);
+    var seconds = elapsed[0] + elapsed[1] / 1e9;
+    console.log(name + ': ' + shares + ' shares in ' + seconds.toFixed(3) + ' s, ' +
+        (shares / seconds).toFixed(1) + ' shares/s');
+}
+
+run('js pipeline', jsPipeline);
+run('validateShare', nativePipeline);
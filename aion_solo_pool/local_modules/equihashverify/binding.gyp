@@ -1,4 +1,8 @@
 {
+    "variables": {
+        # Equihash verifier library shared with the reference miner
+        "equiverify_root": "../../../aion_reference_miner",
+    },
     "targets": [
         {
             "target_name": "equihashverify",
@@ -9,7 +13,8 @@
                 "equihashverify.cc",
             ],
             "include_dirs": [
-                "<!(node -e \"require('nan')\")"
+                "<!(node -e \"require('nan')\")",
+                "<(equiverify_root)",
             ],
             "defines": [
             ],
@@ -30,18 +35,19 @@
             "dependencies": [
             ],
             "sources": [
-                "src/blake/blake2-config.h",
-                "src/blake/blake2-impl.h",
-                "src/blake/blake2-round.h",
-                "src/blake/blake2.h",
-                "src/blake/blake2b-load-sse2.h",
-                "src/blake/blake2b-load-sse41.h",
-                "src/blake/blake2b-round.h",
-                "src/blake/blake2b.cpp",
-                "src/equi/equi210.cpp",
-                "src/equi/endian.c",
+                "<(equiverify_root)/blake2/blake2.h",
+                "<(equiverify_root)/blake2/blake2bx.cpp",
+                "<(equiverify_root)/blake2/blake2b-lanes.h",
+                "<(equiverify_root)/blake2/blake2b-lanes.cpp",
+                "<(equiverify_root)/equiverify/equiverify.h",
+                "<(equiverify_root)/equiverify/equiverify.cpp",
+                "src/share/submitindex.h",
+                "src/share/submitindex.cpp",
+                "src/share/validateshare.h",
+                "src/share/validateshare.cpp",
             ],
             "include_dirs": [
+                "<(equiverify_root)",
             ],
             "defines": [
             ],
@@ -1,9 +1,13 @@
 #include <nan.h>
 #include <node.h>
 #include <node_buffer.h>
+#include <node_object_wrap.h>
 #include <v8.h>
 #include <stdint.h>
-#include "src/equi/equi210.h"
+#include <vector>
+#include "equiverify/equiverify.h"
+#include "src/share/submitindex.h"
+#include "src/share/validateshare.h"
 
 using namespace v8;
 
@@ -27,19 +31,213 @@ void Verify(const v8::FunctionCallbackInfo<Value>& args) {
   return;
   }
 
-  const char *hdr = node::Buffer::Data(header);
-  const char *soln = node::Buffer::Data(solution);
+  if (node::Buffer::Length(header) < 64) {
+  isolate->ThrowException(Exception::TypeError(
+    String::NewFromUtf8(isolate, "Header should be at least 64 bytes.")));
+  return;
+  }
+
+  // Header hash and nonce are the first 64 bytes of the header
+  int code = equiverify_verify((const unsigned char *)node::Buffer::Data(header), 64,
+                               (const unsigned char *)node::Buffer::Data(solution),
+                               node::Buffer::Length(solution));
+  args.GetReturnValue().Set(code == EQUIVERIFY_OK);
+
+}
+
+void VerifyBatch(const v8::FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = Isolate::GetCurrent();
+  HandleScope scope(isolate);
+
+  if (args.Length() < 1 || !args[0]->IsArray()) {
+  isolate->ThrowException(Exception::TypeError(
+    String::NewFromUtf8(isolate, "Argument should be an array of {header, solution} objects.")));
+  return;
+  }
+
+  Local<Array> shares = Local<Array>::Cast(args[0]);
+  Local<String> headerKey = String::NewFromUtf8(isolate, "header");
+  Local<String> solutionKey = String::NewFromUtf8(isolate, "solution");
+
+  uint32_t count = shares->Length();
+  std::vector<equiverify_share> batch;
+  std::vector<uint32_t> positions;
+  batch.reserve(count);
+  positions.reserve(count);
+
+  // Malformed entries are reported as invalid instead of failing the batch
+  for (uint32_t i = 0; i < count; i++) {
+    Local<Value> entry = shares->Get(i);
+    if (!entry->IsObject()) {
+      continue;
+    }
+    Local<Value> header = entry->ToObject()->Get(headerKey);
+    Local<Value> solution = entry->ToObject()->Get(solutionKey);
+    if (!node::Buffer::HasInstance(header) || !node::Buffer::HasInstance(solution)) {
+      continue;
+    }
+    if (node::Buffer::Length(header) < 64) {
+      continue;
+    }
+    equiverify_share share;
+    share.header = (const unsigned char *)node::Buffer::Data(header);
+    share.header_len = 64;
+    share.solution = (const unsigned char *)node::Buffer::Data(solution);
+    share.solution_len = node::Buffer::Length(solution);
+    batch.push_back(share);
+    positions.push_back(i);
+  }
 
-  int n = 210;
-  int k = 9;
+  std::vector<int> valid(batch.size());
+  equiverify_verify_many(batch.data(), batch.size(), valid.data());
 
-  bool result = verifyEH(hdr, soln, n, k);
+  Local<Array> result = Array::New(isolate, count);
+  for (uint32_t i = 0; i < count; i++) {
+    result->Set(i, Boolean::New(isolate, false));
+  }
+  for (size_t i = 0; i < positions.size(); i++) {
+    result->Set(positions[i], Boolean::New(isolate, valid[i] == EQUIVERIFY_OK));
+  }
   args.GetReturnValue().Set(result);
 
 }
 
+void ValidateShare(const v8::FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = Isolate::GetCurrent();
+  HandleScope scope(isolate);
+
+  if (args.Length() < 4) {
+  isolate->ThrowException(Exception::TypeError(
+    String::NewFromUtf8(isolate, "Wrong number of arguments")));
+  return;
+  }
+
+  Local<Object> header = args[0]->ToObject();
+  Local<Object> nonce = args[1]->ToObject();
+  Local<Object> solution = args[2]->ToObject();
+  Local<Object> target = args[3]->ToObject();
+
+  if(!node::Buffer::HasInstance(header) || !node::Buffer::HasInstance(nonce) ||
+     !node::Buffer::HasInstance(solution) || !node::Buffer::HasInstance(target)) {
+  isolate->ThrowException(Exception::TypeError(
+    String::NewFromUtf8(isolate, "Arguments should be buffer objects.")));
+  return;
+  }
+
+  if(node::Buffer::Length(header) != 32 || node::Buffer::Length(nonce) != 32 ||
+     node::Buffer::Length(solution) != 1408 || node::Buffer::Length(target) != 32) {
+  isolate->ThrowException(Exception::TypeError(
+    String::NewFromUtf8(isolate, "Expected 32 byte header hash, nonce and target and a 1408 byte solution.")));
+  return;
+  }
+
+  // Optional fifth argument: false skips the Equihash check (sampled shares)
+  bool verifySolution = args.Length() < 5 || !args[4]->IsFalse();
+
+  unsigned char hash[32];
+  int code = validateShare(node::Buffer::Data(header), node::Buffer::Data(nonce),
+                           node::Buffer::Data(solution),
+                           (const unsigned char *)node::Buffer::Data(target), hash,
+                           verifySolution);
+
+  // Hash as a double, so the pool can derive the share difficulty without bignum
+  double hashValue = 0;
+  for (int i = 0; i < 32; i++) {
+    hashValue = hashValue * 256 + hash[i];
+  }
+
+  Local<Object> result = Object::New(isolate);
+  result->Set(String::NewFromUtf8(isolate, "valid"),
+              Boolean::New(isolate, code == SHARE_OK || code == SHARE_UNVERIFIED));
+  result->Set(String::NewFromUtf8(isolate, "verified"),
+              Boolean::New(isolate, code == SHARE_OK || code == SHARE_INVALID_SOLUTION));
+  if (code == SHARE_INVALID_SOLUTION) {
+    result->Set(String::NewFromUtf8(isolate, "error"), String::NewFromUtf8(isolate, "invalid solution"));
+  } else if (code == SHARE_ABOVE_TARGET) {
+    result->Set(String::NewFromUtf8(isolate, "error"), String::NewFromUtf8(isolate, "Header hash larger than target"));
+  } else {
+    result->Set(String::NewFromUtf8(isolate, "error"), Null(isolate));
+  }
+  result->Set(String::NewFromUtf8(isolate, "hash"),
+              Nan::CopyBuffer((const char *)hash, 32).ToLocalChecked());
+  result->Set(String::NewFromUtf8(isolate, "hashValue"), Number::New(isolate, hashValue));
+  args.GetReturnValue().Set(result);
+
+}
+
+// Duplicate share index owned by a single pool job
+class SubmitIndexWrap : public node::ObjectWrap {
+ public:
+  static void Init(Handle<Object> exports) {
+    Isolate* isolate = Isolate::GetCurrent();
+
+    Local<FunctionTemplate> tpl = FunctionTemplate::New(isolate, New);
+    tpl->SetClassName(String::NewFromUtf8(isolate, "SubmitIndex"));
+    tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+    NODE_SET_PROTOTYPE_METHOD(tpl, "add", Add);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "size", Size);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "memoryUsage", MemoryUsage);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "clear", Clear);
+
+    exports->Set(String::NewFromUtf8(isolate, "SubmitIndex"), tpl->GetFunction());
+  }
+
+ private:
+  SubmitIndex index;
+
+  static void New(const v8::FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = Isolate::GetCurrent();
+    HandleScope scope(isolate);
+
+    if (!args.IsConstructCall()) {
+    isolate->ThrowException(Exception::TypeError(
+      String::NewFromUtf8(isolate, "SubmitIndex must be called with new")));
+    return;
+    }
+
+    SubmitIndexWrap* wrap = new SubmitIndexWrap();
+    wrap->Wrap(args.This());
+    args.GetReturnValue().Set(args.This());
+  }
+
+  static void Add(const v8::FunctionCallbackInfo<Value>& args) {
+    Isolate* isolate = Isolate::GetCurrent();
+    HandleScope scope(isolate);
+
+    if (args.Length() < 1 || !args[0]->IsString()) {
+    isolate->ThrowException(Exception::TypeError(
+      String::NewFromUtf8(isolate, "Argument should be a string key.")));
+    return;
+    }
+
+    SubmitIndexWrap* wrap = ObjectWrap::Unwrap<SubmitIndexWrap>(args.Holder());
+    String::Utf8Value key(args[0]);
+    args.GetReturnValue().Set(wrap->index.insert(*key, key.length()));
+  }
+
+  static void Size(const v8::FunctionCallbackInfo<Value>& args) {
+    SubmitIndexWrap* wrap = ObjectWrap::Unwrap<SubmitIndexWrap>(args.Holder());
+    args.GetReturnValue().Set((double)wrap->index.size());
+  }
+
+  static void MemoryUsage(const v8::FunctionCallbackInfo<Value>& args) {
+    SubmitIndexWrap* wrap = ObjectWrap::Unwrap<SubmitIndexWrap>(args.Holder());
+    args.GetReturnValue().Set((double)wrap->index.memoryUsage());
+  }
+
+  static void Clear(const v8::FunctionCallbackInfo<Value>& args) {
+    SubmitIndexWrap* wrap = ObjectWrap::Unwrap<SubmitIndexWrap>(args.Holder());
+    wrap->index.clear();
+  }
+};
+
 void Init(Handle<Object> exports) {
+  equiverify_init();
   NODE_SET_METHOD(exports, "verify", Verify);
+  NODE_SET_METHOD(exports, "verifyBatch", VerifyBatch);
+  NODE_SET_METHOD(exports, "validateShare", ValidateShare);
+  SubmitIndexWrap::Init(exports);
 }
 
 NODE_MODULE(equihashverify, Init)
@@ -1,375 +0,0 @@
-// Modified 2017-2018 AION Foundation 
-// Copyright (c) 2016 Jack Grigg
-// Copyright (c) 2016 The Zcash developers
-// Distributed under the MIT software license, see the accompanying
-// file COPYING or http://www.opensource.org/licenses/mit-license.php.
-
-// Implementation of the Equihash Proof-of-Work algorithm.
-//
-// Reference
-// =========
-// Alex Biryukov and Dmitry Khovratovich
-// Equihash: Asymmetric Proof-of-Work Based on the Generalized Birthday Problem
-// NDSS ’16, 21-24 February 2016, San Diego, CA, USA
-// https://www.internetsociety.org/sites/default/files/blogs-media/equihash-asymmetric-proof-of-work-based-generalized-birthday-problem.pdf
-
-
-#include "endian.h"
-#include "equi210.h"
-
-#include <algorithm>
-#include <iostream>
-#include <stdexcept>
-
-
-bool verifyEH(const char *hdr, const char *soln, int n, int k){
-
-    size_t cBitLen { n /(k+1)};
-    blake2b_state state;
-    EhInitialiseState(n, k, &state);
-
-    //Update header and nonce in same call
-    blake2b_update(&state, (unsigned char*)&hdr[0], 64);
-
-    std::vector<unsigned char> minimal(soln, soln + 1408);
-
-    bool isValid;
-    EhIsValidSolution(n,k,&state, minimal, isValid);    
-    return isValid;
-}
-
-
-template<unsigned int N, unsigned int K>
-int Equihash<N,K>::InitialiseState(blake2b_state *base_state)
-{
-    uint32_t le_N = htole32(N);
-    uint32_t le_K = htole32(K);
-    unsigned char personalization[16] = {};
-    memcpy(personalization, "AION0PoW", 8);
-    memcpy(personalization+8,  &le_N, 4);
-    memcpy(personalization+12, &le_K, 4);
-
-    blake2b_param P[1];
-    P->digest_length = HashOutput;
-    P->key_length    = 0;
-    P->fanout        = 1;
-    P->depth         = 1;
-    P->leaf_length   = 0;
-    P->node_offset   = 0;
-    P->node_depth    = 0;
-    P->inner_length  = 0;
-    memset(P->reserved, 0, sizeof(P->reserved));
-    memset(P->salt,     0, sizeof(P->salt));
-    memcpy(P->personal, (const uint8_t *)personalization, 16);
-    blake2b_init_param(base_state, P);
-}
-
-void GenerateHash(blake2b_state *base_state, eh_index g,
-                  unsigned char* hash, size_t hLen)
-{
-    blake2b_state state = *base_state;
-    eh_index lei = htole32(g);
-    blake2b_update(&state, (const unsigned char*) &lei,
-                                      sizeof(eh_index));
-    blake2b_final(&state, hash, hLen);
-}
-
-void ExpandArray(const unsigned char* in, size_t in_len,
-                 unsigned char* out, size_t out_len,
-                 size_t bit_len, size_t byte_pad)
-{
-
-    size_t out_width { (bit_len+7)/8 + byte_pad };
-
-    uint32_t bit_len_mask { ((uint32_t)1 << bit_len) - 1 };
-
-    // The acc_bits least-significant bits of acc_value represent a bit sequence
-    // in big-endian order.
-    size_t acc_bits = 0;
-    uint32_t acc_value = 0;
-
-    size_t j = 0;
-    for (size_t i = 0; i < in_len; i++) {
-        acc_value = (acc_value << 8) | in[i];
-        acc_bits += 8;
-
-        // When we have bit_len or more bits in the accumulator, write the next
-        // output element.
-        if (acc_bits >= bit_len) {
-            acc_bits -= bit_len;
-            for (size_t x = 0; x < byte_pad; x++) {
-                out[j+x] = 0;
-            }
-            for (size_t x = byte_pad; x < out_width; x++) {
-                out[j+x] = (
-                    // Big-endian
-                    acc_value >> (acc_bits+(8*(out_width-x-1)))
-                ) & (
-                    // Apply bit_len_mask across byte boundaries
-                    (bit_len_mask >> (8*(out_width-x-1))) & 0xFF
-                );
-            }
-            j += out_width;
-        }
-    }
-}
-
-void CompressArray(const unsigned char* in, size_t in_len,
-                   unsigned char* out, size_t out_len,
-                   size_t bit_len, size_t byte_pad)
-{
-    size_t in_width { (bit_len+7)/8 + byte_pad };
-
-    uint32_t bit_len_mask { ((uint32_t)1 << bit_len) - 1 };
-
-    // The acc_bits least-significant bits of acc_value represent a bit sequence
-    // in big-endian order.
-    size_t acc_bits = 0;
-    uint32_t acc_value = 0;
-
-    size_t j = 0;
-    for (size_t i = 0; i < out_len; i++) {
-        // When we have fewer than 8 bits left in the accumulator, read the next
-        // input element.
-        if (acc_bits < 8) {
-            acc_value = acc_value << bit_len;
-            for (size_t x = byte_pad; x < in_width; x++) {
-                acc_value = acc_value | (
-                    (
-                        // Apply bit_len_mask across byte boundaries
-                        in[j+x] & ((bit_len_mask >> (8*(in_width-x-1))) & 0xFF)
-                    ) << (8*(in_width-x-1))); // Big-endian
-            }
-            j += in_width;
-            acc_bits += bit_len;
-        }
-
-        acc_bits -= 8;
-        out[i] = (acc_value >> acc_bits) & 0xFF;
-    }
-}
-
-// Big-endian so that lexicographic array comparison is equivalent to integer
-// comparison
-void EhIndexToArray(const eh_index i, unsigned char* array)
-{
-    eh_index bei = htobe32(i);
-    memcpy(array, &bei, sizeof(eh_index));
-}
-
-// Big-endian so that lexicographic array comparison is equivalent to integer
-// comparison
-eh_index ArrayToEhIndex(const unsigned char* array)
-{
-    eh_index bei;
-    memcpy(&bei, array, sizeof(eh_index));
-    return be32toh(bei);
-}
-
-eh_trunc TruncateIndex(const eh_index i, const unsigned int ilen)
-{
-    // Truncate to 8 bits
-    return (i >> (ilen - 8)) & 0xff;
-}
-
-eh_index UntruncateIndex(const eh_trunc t, const eh_index r, const unsigned int ilen)
-{
-    eh_index i{t};
-    return (i << (ilen - 8)) | r;
-}
-
-std::vector<eh_index> GetIndicesFromMinimal(std::vector<unsigned char> minimal,
-                                            size_t cBitLen)
-{
-    size_t lenIndices { 8*sizeof(eh_index)*minimal.size()/(cBitLen+1) };
-    size_t bytePad { sizeof(eh_index) - ((cBitLen+1)+7)/8 };
-    std::vector<unsigned char> array(lenIndices);
-    ExpandArray(minimal.data(), minimal.size(),
-                array.data(), lenIndices, cBitLen+1, bytePad);
-    std::vector<eh_index> ret;
-    for (int i = 0; i < lenIndices; i += sizeof(eh_index)) {
-        ret.push_back(ArrayToEhIndex(array.data()+i));
-    }
-    return ret;
-}
-
-std::vector<unsigned char> GetMinimalFromIndices(std::vector<eh_index> indices,
-                                                 size_t cBitLen)
-{
-    size_t lenIndices { indices.size()*sizeof(eh_index) };
-    size_t minLen { (cBitLen+1)*lenIndices/(8*sizeof(eh_index)) };
-    size_t bytePad { sizeof(eh_index) - ((cBitLen+1)+7)/8 };
-    std::vector<unsigned char> array(lenIndices);
-    for (int i = 0; i < indices.size(); i++) {
-        EhIndexToArray(indices[i], array.data()+(i*sizeof(eh_index)));
-    }
-    std::vector<unsigned char> ret(minLen);
-    CompressArray(array.data(), lenIndices,
-                  ret.data(), minLen, cBitLen+1, bytePad);
-    return ret;
-}
-
-template<size_t WIDTH>
-StepRow<WIDTH>::StepRow(const unsigned char* hashIn, size_t hInLen,
-                        size_t hLen, size_t cBitLen)
-{
-    memset(hash,0, sizeof(hash)/sizeof(hash[0]));
-    ExpandArray(hashIn, hInLen, hash, hLen, cBitLen);
-}
-
-template<size_t WIDTH> template<size_t W>
-StepRow<WIDTH>::StepRow(const StepRow<W>& a)
-{
-    memset(hash,0, sizeof(hash)/sizeof(hash[0]));
-    std::copy(a.hash, a.hash+W, hash);
-}
-
-template<size_t WIDTH>
-FullStepRow<WIDTH>::FullStepRow(const unsigned char* hashIn, size_t hInLen,
-                                size_t hLen, size_t cBitLen, eh_index i) :
-        StepRow<WIDTH> {hashIn, hInLen, hLen, cBitLen}
-{
-    EhIndexToArray(i, hash+hLen);
-}
-
-template<size_t WIDTH> template<size_t W>
-FullStepRow<WIDTH>::FullStepRow(const FullStepRow<W>& a, const FullStepRow<W>& b, size_t len, size_t lenIndices, int trim) :
-        StepRow<WIDTH> {a}
-{
-    for (int i = trim; i < len; i++)
-        hash[i-trim] = a.hash[i] ^ b.hash[i];
-    if (a.IndicesBefore(b, len, lenIndices)) {
-        std::copy(a.hash+len, a.hash+len+lenIndices, hash+len-trim);
-        std::copy(b.hash+len, b.hash+len+lenIndices, hash+len-trim+lenIndices);
-    } else {
-        std::copy(b.hash+len, b.hash+len+lenIndices, hash+len-trim);
-        std::copy(a.hash+len, a.hash+len+lenIndices, hash+len-trim+lenIndices);
-    }
-}
-
-template<size_t WIDTH>
-FullStepRow<WIDTH>& FullStepRow<WIDTH>::operator=(const FullStepRow<WIDTH>& a)
-{
-    std::copy(a.hash, a.hash+WIDTH, hash);
-    return *this;
-}
-
-template<size_t WIDTH>
-bool StepRow<WIDTH>::IsZero(size_t len)
-{
-    // This doesn't need to be constant time.
-    for (int i = 0; i < len; i++) {
-        if (hash[i] != 0){
-            return false;
-        }
-    }
-    return true;
-}
-
-template<size_t WIDTH>
-std::vector<unsigned char> FullStepRow<WIDTH>::GetIndices(size_t len, size_t lenIndices,
-                                                          size_t cBitLen) const
-{
-    size_t minLen { (cBitLen+1)*lenIndices/(8*sizeof(eh_index)) };
-    size_t bytePad { sizeof(eh_index) - ((cBitLen+1)+7)/8 };
-    std::vector<unsigned char> ret(minLen);
-    ret.assign(minLen, 0);
-    CompressArray(hash+len, lenIndices, ret.data(), minLen, cBitLen+1, bytePad);
-    return ret;
-}
-
-template<size_t WIDTH>
-bool HasCollision(StepRow<WIDTH>& a, StepRow<WIDTH>& b, int l)
-{
-    // This doesn't need to be constant time.
-    for (int j = 0; j < l; j++) {
-        if (a.hash[j] != b.hash[j]){
-            return false;
-        }
-    }
-    return true;
-}
-
-template<size_t WIDTH>
-TruncatedStepRow<WIDTH>::TruncatedStepRow(const unsigned char* hashIn, size_t hInLen,
-                                          size_t hLen, size_t cBitLen,
-                                          eh_index i, unsigned int ilen) :
-        StepRow<WIDTH> {hashIn, hInLen, hLen, cBitLen}
-{
-    hash[hLen] = TruncateIndex(i, ilen);
-}
-
-template<size_t WIDTH> template<size_t W>
-TruncatedStepRow<WIDTH>::TruncatedStepRow(const TruncatedStepRow<W>& a, const TruncatedStepRow<W>& b, size_t len, size_t lenIndices, int trim) :
-        StepRow<WIDTH> {a}
-{
-    for (int i = trim; i < len; i++)
-        hash[i-trim] = a.hash[i] ^ b.hash[i];
-    if (a.IndicesBefore(b, len, lenIndices)) {
-        std::copy(a.hash+len, a.hash+len+lenIndices, hash+len-trim);
-        std::copy(b.hash+len, b.hash+len+lenIndices, hash+len-trim+lenIndices);
-    } else {
-        std::copy(b.hash+len, b.hash+len+lenIndices, hash+len-trim);
-        std::copy(a.hash+len, a.hash+len+lenIndices, hash+len-trim+lenIndices);
-    }
-}
-
-template<size_t WIDTH>
-TruncatedStepRow<WIDTH>& TruncatedStepRow<WIDTH>::operator=(const TruncatedStepRow<WIDTH>& a)
-{
-    std::copy(a.hash, a.hash+WIDTH, hash);
-    return *this;
-}
-
-template<size_t WIDTH>
-std::shared_ptr<eh_trunc> TruncatedStepRow<WIDTH>::GetTruncatedIndices(size_t len, size_t lenIndices) const
-{
-    std::shared_ptr<eh_trunc> p (new eh_trunc[lenIndices], std::default_delete<eh_trunc[]>());
-    std::copy(hash+len, hash+len+lenIndices, p.get());
-    return p;
-}
-
-template<unsigned int N, unsigned int K>
-bool Equihash<N,K>::IsValidSolution(blake2b_state *base_state, std::vector<unsigned char> soln)
-{
-    if (soln.size() != SolutionWidth) {
-        return false;
-    }
-
-    std::vector<FullStepRow<FinalFullWidth>> X;
-    X.reserve(1 << K);
-    unsigned char tmpHash[HashOutput] = {};
-
-    for (eh_index i : GetIndicesFromMinimal(soln, CollisionBitLength)) {
-        GenerateHash(base_state, i/IndicesPerHashOutput, tmpHash, HashOutput);
-        X.emplace_back(tmpHash+((i % IndicesPerHashOutput) * HashLen),
-                       HashLen, HashLength, CollisionBitLength, i);
-    }
-
-    size_t hashLen = HashLength;
-    size_t lenIndices = sizeof(eh_index);
-    while (X.size() > 1) {
-        std::vector<FullStepRow<FinalFullWidth>> Xc;
-        for (int i = 0; i < X.size(); i += 2) {
-            if (!HasCollision(X[i], X[i+1], CollisionByteLength)) {
-                return false;
-            }
-            if (X[i+1].IndicesBefore(X[i], hashLen, lenIndices)) {
-                return false;
-            }
-            if (!DistinctIndices(X[i], X[i+1], hashLen, lenIndices)) {
-                return false;
-            }
-            Xc.emplace_back(X[i], X[i+1], hashLen, lenIndices, CollisionByteLength);
-        }
-        X = Xc;
-        hashLen -= CollisionByteLength;
-        lenIndices *= 2;
-    }
-
-    return X[0].IsZero(hashLen);
-}
-
-// Explicit instantiations for Equihash<210,9>
-template int Equihash<210,9>::InitialiseState(blake2b_state *base_state);
-template bool Equihash<210,9>::IsValidSolution(blake2b_state *base_state, std::vector<unsigned char> soln);
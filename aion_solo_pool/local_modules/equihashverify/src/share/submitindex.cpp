@@ -0,0 +1,32 @@
+// Modified 2017-2018 AION Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "submitindex.h"
+
+bool SubmitIndex::insert(const char *key, size_t len)
+{
+    auto inserted = keys.emplace(key, len);
+    if (!inserted.second)
+        return false;
+
+    // Keys longer than the small string buffer live in their own allocation
+    const std::string &stored = *inserted.first;
+    const char *inlineBuf = reinterpret_cast<const char *>(&stored);
+    if (stored.data() < inlineBuf || stored.data() >= inlineBuf + sizeof(std::string))
+        keyBytes += stored.capacity() + 1;
+    return true;
+}
+
+void SubmitIndex::clear()
+{
+    std::unordered_set<std::string>().swap(keys);
+    keyBytes = 0;
+}
+
+size_t SubmitIndex::memoryUsage() const
+{
+    // A node holds the next pointer, the cached hash and the string itself
+    const size_t nodeBytes = sizeof(void *) + sizeof(size_t) + sizeof(std::string);
+    return keys.bucket_count() * sizeof(void *) + keys.size() * nodeBytes + keyBytes;
+}
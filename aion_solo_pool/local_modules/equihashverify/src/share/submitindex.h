@@ -0,0 +1,32 @@
+// Modified 2017-2018 AION Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Per-job index of submitted shares, used by the pool to reject duplicate
+// and replayed shares before any hashing or Equihash verification.
+
+#ifndef __SUBMITINDEX_H__
+#define __SUBMITINDEX_H__
+
+#include <cstddef>
+#include <string>
+#include <unordered_set>
+
+class SubmitIndex
+{
+public:
+    // Returns false if the key was already registered
+    bool insert(const char *key, size_t len);
+    // Drops all keys and releases the bucket array
+    void clear();
+
+    size_t size() const { return keys.size(); }
+    // Estimated heap usage in bytes: buckets, nodes and key storage
+    size_t memoryUsage() const;
+
+private:
+    std::unordered_set<std::string> keys;
+    size_t keyBytes = 0;
+};
+
+#endif
@@ -0,0 +1,40 @@
+// Modified 2017-2018 AION Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "validateshare.h"
+
+#include "blake2/blake2.h"
+#include "equiverify/equiverify.h"
+
+#include <cstring>
+
+int validateShare(const char *hdr, const char *nonce, const char *soln,
+                  const unsigned char *target, unsigned char *hash,
+                  bool verifySolution){
+
+    // Header hash, nonce and solution are streamed into one BLAKE2b instance
+    // instead of being concatenated into a full header first.
+    blake2b_state state;
+    blake2b_init(&state, 32);
+    blake2b_update(&state, (const unsigned char*)hdr, 32);
+    blake2b_update(&state, (const unsigned char*)nonce, 32);
+    blake2b_update(&state, (const unsigned char*)soln, EQUIVERIFY_SOLUTION_BYTES);
+    blake2b_final(&state, hash, 32);
+
+    // Reject on target first, it is a fraction of the cost of the Equihash check
+    if (memcmp(hash, target, 32) > 0) {
+        return SHARE_ABOVE_TARGET;
+    }
+
+    if (!verifySolution) {
+        return SHARE_UNVERIFIED;
+    }
+
+    unsigned char header[64];
+    memcpy(header, hdr, 32);
+    memcpy(header + 32, nonce, 32);
+    int code = equiverify_verify(header, sizeof(header), (const unsigned char*)soln,
+                                 EQUIVERIFY_SOLUTION_BYTES);
+    return code == EQUIVERIFY_OK ? SHARE_OK : SHARE_INVALID_SOLUTION;
+}
@@ -0,0 +1,18 @@
+// Modified 2017-2018 AION Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Pool-side share check: target hash, target compare and Equihash
+// verification through the equiverify library.
+
+#ifndef __VALIDATESHARE_H__
+#define __VALIDATESHARE_H__
+
+// SHARE_UNVERIFIED: the hash meets the target, the solution was not checked
+enum share_code { SHARE_OK, SHARE_INVALID_SOLUTION, SHARE_ABOVE_TARGET, SHARE_UNVERIFIED };
+
+int validateShare(const char *hdr, const char *nonce, const char *soln,
+                  const unsigned char *target, unsigned char *hash,
+                  bool verifySolution = true);
+
+#endif
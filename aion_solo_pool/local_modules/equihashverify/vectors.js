@@ -0,0 +1,3 @@
+// Valid Equihash 210,9 share: 64 byte header (header hash + nonce) and 1408 byte solution
+exports.header = '8b6ca38e5990b049dcd39281ee236bd512f8e40bc1bd184bd2898bfa7628fb19bc4fe05100000000010000000000000000000000000000000000000000000000';
+exports.solution = '0007e15ff581ce21149c4b119ba719b6a48e87e369e71becbce53dd59c16b744e381885bcfd97825e273a4b3030988f3f1f797782c68881592269d108affb07c640e0ad0488819bbefbfbc8b7c860b76bb0b6a57c03a3ca302f0b8754afca9a4794ef71983210c9f29807233faee03ce831a0e73d5f5997b2f8a745ed206bb21612fde9e1ad7d5cfac32d147fb68749de3dafffa4a367bbaf6235e399eec609875fa228c2771cade47c57b7c9d781611015020cc434ae1c230e16c444666b1e13bc4bbb6fcae04869bd07a72896aa6b11475645f21ad5bfe75763f9b03476174b17255d89619d3445419aa41c6475633bad320b45975737c47cafb1aae2a56e5e3d885e9ee329ef408f6575a6350dc5933ac6930d013af77c82061284e610a9caacd6662f3f8356fdb19f8cceb91d63eccbfe262382e5a0771d47b6bd2ee7c68b7a6951d7a5549f225b991077327693a8dc33c21e79ca2c7e8c73c1dcbf8361f0510c5583c168c3d7e1f2e42a3e120fef6be14e131a310f64a8dbdc8c54be5ce9e388ca36e8da3da2a9d54680618071c6f057618aded8009d65029e65391a076c18e2e7ffe52b03a9c6677d3a35a987a16dc0eae2b7ffb120687fb3d9809384cb96a3d39518da9417977e42b9aad101da3f4549490ef7877186681425bf3c94fdd2810562bd0f0dbbeb621492765d47537fa34e9596b1fb170e97c843a5e5739118775ccf58b45924821695474b8f24c054fe2e1584332c739709139e987644db620b37ab2a843c88944ed4479fde048195612bead5997b5f1fb3b520af449d73832a33cb4e5ee5b568716eb45b8857d18192d4f1eaebaa3826b1125718a913b0f9daa5d7b2981ea05fef8c663521519f310300619f53aa0c99a33360d1109201e60a6a10ec79b5ab21bca224860360014bec6681fc1996199291f7a31e601451beec973d5a212e4f5f524beeb4ea0e4d7ff3fe49947ec2e548475ceafdb535e023eadba3114e3d2206186934a53d51c4b2a4439c6cb3db3367b962e29023a267d72f979fe119e6be2bcad6408e5e70c5fa748b82eecda89dc67963ddaec243bfc4209fbeb2395b82df8eb3027622621f34e0df6e63d811c07e3b6ab4bc52ae259154e18e1938da3891ef8b19abe35249df72828dfa1fd1d05502ff7a63a45fa26706c233c7465c3afca317d71b5143fbdad6e6905855b96f03a63ab7eb7f26899af659d6280210ab2688a6cc771328b056c68742925075cec86995e38be102fa76ca6bbdba30665ffa100062a56f74b6f0a4bf6976d843902a7cddc0dd3d3b90633950963c9e5205e22318522a62267a6b4117f12131e111ce09239a620b7b5fdaac269190c75ad0859ea0d5cd64eccb0ee0119f173727ce1bcb38a5ffe49ce59d5df3a6faf2e8c7b5db6e62ec2ddb0023c257b0a1f92fbfff1c25d4ce2602cd5a78c5622f5a75c79e10d4a0dd4f5048882b2f29c1132fd996cc3722775e9120254658ee5877081694497076235492ea47c549544322610acc1e06ed7cbbd15b4833b6669278b78d4fc31780776b5e999d09d4c3e556942a97ff383680e967c322c1ba95a1302fb631635fc9247a59b0e17557a3c350f0d07a40b44cb35e258efa063c015bb0a425c1126f1d6c40feb388d55369f2c20c4347dd2622833cb62552ee24d0feb210d8bcea98d7e40dda2da9e8d373ba488be0b881ab91654817defb6bb6e8820a434ea2372d5d33561ea056391f14f35132baa693c251b574808131588a26cb268fe4e3cae2ac14fb6e3cd7465fb4af1fa9a96b40218073d028a0a663a522d0097677fc26cfabac595b2f4800cb6437865c2a989ed216f6249ff6a99fdb7fefb27360a48b6de7ed7d00ffa366a26a72cab98f750356ccacc0aa609bdb1537e1ee03c0959f053edbc88337fe6c85f1afa8921547a41e4353737697a471087f7b834b799e021d3796e91b58a1d1fe6ac35579dc681f87b4fa4553f';
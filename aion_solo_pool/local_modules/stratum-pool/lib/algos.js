@@ -20,6 +20,11 @@ var algos = module.exports = global.algos = {
             return function(){
                 return ev.verify.apply(this, arguments);
             }
+        },
+        validate: function(){
+            return function(){
+                return ev.validateShare.apply(this, arguments);
+            }
         }
     }
 };
@@ -2,6 +2,7 @@ const bignum = require('bignum')
 const merkleTree = require('./merkleTree.js')
 const transactions = require('./transactions.js')
 const util = require('./util.js')
+const SubmitIndex = require('equihashverify').SubmitIndex
 const diff1 = 0x00000000ffff0000000000000000000000000000000000000000000000000000
 
 /**
@@ -19,7 +20,8 @@ module.exports = function BlockTemplate(
 ){
     //private members
 
-    let submits = []
+    //native hash set of extraNonce1 + extraNonce2 + nTime + nonce, freed by retire()
+    let submits = new SubmitIndex()
 
     function getMerkleHashes(steps){
         return steps.map(function(step){
@@ -61,6 +63,10 @@ module.exports = function BlockTemplate(
 
     this.difficulty = parseFloat((diff1 / this.target.toNumber()).toFixed(9))
 
+    //Binary forms used by the native share validator
+    this.headerHashBuffer = new Buffer(rpcData.headerHash, 'hex')
+    this.targetBuffer = this.target.toBuffer({endian: 'big', size: 32})
+
     this.prevHashReversed = util.reverseByteOrder(new Buffer(rpcData.previousblockhash, 'hex')).toString('hex')
     
     this.serializeCoinbase = function(extraNonce1, extraNonce2){
@@ -116,12 +122,18 @@ module.exports = function BlockTemplate(
     }
 
     this.registerSubmit = function(extraNonce1, extraNonce2, nTime, nonce){
-        var submission = extraNonce1 + extraNonce2 + nTime + nonce
-        if (submits.indexOf(submission) === -1){
-            submits.push(submission)
-            return true
-        }
-        return false
+        return submits.add(extraNonce1 + extraNonce2 + nTime + nonce)
+    }
+
+    this.getSubmitStats = function(){
+        return {submits: submits.size(), memory: submits.memoryUsage()}
+    }
+
+    //Called once the job can no longer receive shares
+    this.retire = function(){
+        var stats = this.getSubmitStats()
+        submits.clear()
+        return stats
     }
 
     this.getJobParams = function(){
@@ -7,6 +7,7 @@ var bignum = require('bignum');
 
 var util = require('./util.js');
 var blockTemplate = require('./blockTemplate.js');
+var ShareTrust = require('./shareTrust.js');
 
 
 
@@ -99,6 +100,8 @@ var JobManager = module.exports = function JobManager(options){
     this.validJobs = {};
 
     var hashDigest = algos[options.coin.algorithm].hash(options.coin);
+    var validateShare = algos[options.coin.algorithm].validate(options.coin);
+    this.shareTrust = new ShareTrust(options.shareSampling);
 
     var coinbaseHasher = (function(){
         switch(options.coin.algorithm){
@@ -148,6 +151,24 @@ var JobManager = module.exports = function JobManager(options){
         }
     })();
 
+    var retireJobs = function(){
+        Object.keys(_this.validJobs).forEach(function(jobId){
+            var stats = _this.validJobs[jobId].retire();
+            _this.emit('log', 'debug', 'Retired job ' + jobId + ': ' + stats.submits +
+                ' submits, ' + (stats.memory / 1024).toFixed(1) + ' KiB submit index');
+        });
+        _this.validJobs = {};
+    };
+
+    //Submit index size and estimated native memory per live job
+    this.getSubmitStats = function(){
+        var stats = {};
+        Object.keys(_this.validJobs).forEach(function(jobId){
+            stats[jobId] = _this.validJobs[jobId].getSubmitStats();
+        });
+        return stats;
+    };
+
     this.updateCurrentJob = function(rpcData){
 
         var tmpBlockTemplate = new blockTemplate(
@@ -202,6 +223,9 @@ var JobManager = module.exports = function JobManager(options){
 
         _this.emit('newBlock', tmpBlockTemplate);
 
+        //Shares for the previous block are stale, free their duplicate indexes
+        retireJobs();
+
         this.validJobs[tmpBlockTemplate.jobId] = tmpBlockTemplate;
 
         return true;
@@ -237,8 +261,10 @@ var JobManager = module.exports = function JobManager(options){
             return shareError([20, 'incorrect size of nonce']);
         }
 
-        // 2816 solution length (1408 * 2 for hex) + 3 bytes buffer header
-        if (soln.length !== 2822) {    
+        // Binary submits carry the 1408 raw bytes, JSON ones 2816 hex
+        // digits + 3 bytes buffer header
+        var binarySoln = Buffer.isBuffer(soln);
+        if (soln.length !== (binarySoln ? 1408 : 2822)) {
             return shareError([20, 'incorrect size of solution']);
         }
         
@@ -246,38 +272,50 @@ var JobManager = module.exports = function JobManager(options){
             return shareError([20, 'invalid hex in extraNonce2']);
         }
 
+        //Duplicates and replays are rejected here, before any hex decoding or hashing
         if (!job.registerSubmit(extraNonce1.toLowerCase(), extraNonce2.toLowerCase(), nTime, nonce)) {
             return shareError([22, 'duplicate share']);
         }
 
-        var headerBuffer = job.serializeHeader("root", nTime, nonce); // 528 bytes (doesn't contain soln)
-        var headerSolnBuffer = new Buffer.concat([headerBuffer, new Buffer(soln.slice(6), 'hex')]);
-        
-        //Change to Blake2b
-        var headerHash = util.blake2(32, headerSolnBuffer);
-        var headerBigNum = bignum.fromBuffer(headerHash, {endian: 'big', size: 32});
+        // Header assembly, both hashes, the target compare and the Equihash
+        // check all happen natively on the binary nonce and solution
+        var solnBuffer = binarySoln ? soln : new Buffer(soln.slice(6), 'hex');
+        var nonceBuffer = new Buffer(nonce, 'hex');
+        var verify = _this.shareTrust.shouldVerify(ipAddress, workerName);
+        var check = validateShare(job.headerHashBuffer, nonceBuffer, solnBuffer, job.targetBuffer, verify);
+
+        // Block candidates are always verified in full, the job target is the
+        // block target. Miners are handed that target today, so until shares
+        // get a target of their own every sampled share lands here. The hash
+        // is already known, only the Equihash check (ev.verify) is left.
+        if (!check.verified && check.valid && Buffer.compare(check.hash, job.targetBuffer) <= 0) {
+            check.verified = true;
+            if (!hashDigest(Buffer.concat([job.headerHashBuffer, nonceBuffer]), solnBuffer)) {
+                check.valid = false;
+                check.error = 'invalid solution';
+            }
+        }
 
         var blockHashInvalid;
         var blockHash;
 
-        var shareDiff = blockTemplate.diff1 / headerBigNum.toNumber() * shareMultiplier;
-        var blockDiffAdjusted = job.difficulty * shareMultiplier;
-
-        // check if valid Equihash solution
-        if (hashDigest(headerBuffer, new Buffer(soln.slice(6), 'hex')) !== true) {
-            return shareError([20, 'invalid solution']);
+        if (!check.valid) {
+            // A trusted worker caught with a bad solution may have had others accepted unverified
+            if (check.verified && _this.shareTrust.recordInvalid(ipAddress, workerName)) {
+                var error = shareError([20, check.error]);
+                error.ban = 'invalid solution while in sampled verification';
+                return error;
+            }
+            return shareError([20, check.error]);
         }
 
-        // check if solution meets target
-        var completeHeader = job.serializeHeaderTarget(nonce, soln, nTime);
-        var completeHeaderHash = new Buffer(util.blake2(32, completeHeader), 'hex');
- 
-        var completeHeaderBigNum = bignum.fromBuffer(completeHeaderHash, {endian: 'big', size: 32});
-
-        if(completeHeaderBigNum.gt(job.target)){
-            return shareError([20, 'Header hash larger than target']);
+        if (check.verified) {
+            _this.shareTrust.recordValid(ipAddress, workerName);
         }
 
+        var shareDiff = blockTemplate.diff1 / check.hashValue * shareMultiplier;
+        var blockDiffAdjusted = job.difficulty * shareMultiplier;
+
         //TODO: Bring this back after share diff adjustment is re-implemented
         // //check if block candidate
         // if (headerBigNum.le(job.target)) {
@@ -302,7 +340,7 @@ var JobManager = module.exports = function JobManager(options){
         //     }
         // }
 
-        blockHash = util.reverseBuffer(headerHash).toString('hex');
+        blockHash = util.reverseBuffer(check.hash).toString('hex');
 
         _this.emit('share', {
             job: jobId,
@@ -315,10 +353,10 @@ var JobManager = module.exports = function JobManager(options){
             shareDiff: shareDiff.toFixed(8),
             blockDiff: blockDiffAdjusted,
             blockDiffActual: job.difficulty,
-            blockHash:completeHeaderHash.toString('hex'),
+            blockHash:check.hash.toString('hex'),
             blockHashInvalid: blockHashInvalid, 
             headerHash: job.rpcData.headerHash
-        }, nTime, nonce, new Buffer(soln.slice(6), 'hex').toString('hex'), job.headerHash);
+        }, nTime, nonce, solnBuffer.toString('hex'), job.headerHash);
 
         return {result: true, error: null, blockHash: blockHash};
     };
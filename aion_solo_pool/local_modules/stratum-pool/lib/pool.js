@@ -530,7 +530,7 @@ var pool = module.exports = function pool(options, authorizeFn){
                     params.soln
                 );
 
-                resultCallback(result.error, result.result ? true : null);
+                resultCallback(result.error, result.result ? true : null, result.ban);
 
             }).on('malformedMessage', function (message) {
                 emitWarningLog('Malformed message from ' + client.getLabel() + ': ' + message);
@@ -0,0 +1,70 @@
+var crypto = require('crypto');
+
+/*
+
+Sampled share verification for workers with a clean history.
+
+A worker (ip + worker name) is trusted once it has submitted trustAfter fully
+verified shares in a row without a failure. After that only sampleRate of its
+shares get the Equihash check, the rest are accepted on the hash/target check
+alone. Block candidates are always verified by the caller.
+
+ */
+
+var ShareTrust = module.exports = function ShareTrust(samplingOptions){
+
+    var enabled = samplingOptions && samplingOptions.enabled === true;
+    var trustAfter = enabled && samplingOptions.trustAfter || 1000;
+    var sampleRate = enabled && typeof(samplingOptions.sampleRate) === 'number' ?
+        samplingOptions.sampleRate : 0.1;
+
+    var workers = {};
+
+    this.stats = {verified: 0, skipped: 0, revoked: 0};
+
+    function getWorker(ipAddress, workerName){
+        var key = ipAddress + '/' + workerName;
+        if (!(key in workers))
+            workers[key] = {cleanShares: 0, trusted: false};
+        return workers[key];
+    }
+
+    //uniform in [0, 1), not predictable by the miner
+    function random(){
+        return crypto.randomBytes(4).readUInt32LE(0) / 0x100000000;
+    }
+
+    //true if the Equihash solution of this share has to be checked
+    this.shouldVerify = function(ipAddress, workerName){
+        if (!enabled)
+            return true;
+        var worker = getWorker(ipAddress, workerName);
+        if (!worker.trusted || random() < sampleRate){
+            this.stats.verified++;
+            return true;
+        }
+        this.stats.skipped++;
+        return false;
+    };
+
+    this.recordValid = function(ipAddress, workerName){
+        if (!enabled)
+            return;
+        var worker = getWorker(ipAddress, workerName);
+        if (!worker.trusted && ++worker.cleanShares >= trustAfter)
+            worker.trusted = true;
+    };
+
+    //returns true if the worker was trusted, meaning unverified shares may have slipped through
+    this.recordInvalid = function(ipAddress, workerName){
+        if (!enabled)
+            return false;
+        var worker = getWorker(ipAddress, workerName);
+        var wasTrusted = worker.trusted;
+        worker.cleanShares = 0;
+        worker.trusted = false;
+        if (wasTrusted)
+            this.stats.revoked++;
+        return wasTrusted;
+    };
+};
@@ -6,6 +6,8 @@ var fs = require('fs');
 
 var util = require('./util.js');
 
+// Starts a binary submit frame, a JSON line cannot begin with it
+var BINARY_SUBMIT_MARKER = 0x02;
 
 var SubscriptionCounter = function(){
     var count = 0;
@@ -24,7 +26,11 @@ var SubscriptionCounter = function(){
  * Defining each client that connects to the stratum server. 
  * Emits:
  *  - subscription(obj, cback(error, extraNonce1, extraNonce2Size))
- *  - submit(data(name, jobID, extraNonce2, ntime, nonce))
+ *  - submit(data(name, jobID, extraNonce2, ntime, nonce, soln))
+ *
+ * A client that sends mining.binary_submit.subscribe may then submit shares
+ * as binary frames, soln is a Buffer of the raw solution for those and hex
+ * with its size prefix for JSON submits.
 **/
 var StratumClient = function(options){
     var pendingDifficulty = null;
@@ -88,6 +94,14 @@ var StratumClient = function(options){
                     error: [20, "Not supported.", null]
                 });
                 break;
+            case 'mining.binary_submit.subscribe':
+                _this.binarySubmit = true;
+                sendJson({
+                    id: message.id,
+                    result: true,
+                    error: null
+                });
+                break;
             default:
                 _this.emit('unknownStratumMethod', message);
                 break;
@@ -176,7 +190,12 @@ var StratumClient = function(options){
                 soln        : message.params[4],
                 nonce       : _this.extraNonce1 + message.params[3]
             },
-            function(error, result){
+            function(error, result, ban){
+                if (ban && banning && banning.enabled){
+                    _this.emit('triggerBan', ban);
+                    _this.socket.destroy();
+                    return;
+                }
                 if (!considerBan(result)){
                     sendJson({
                         id: message.id,
@@ -188,6 +207,33 @@ var StratumClient = function(options){
         );
     }
 
+    /**
+     * Frame payload: request id (uint32 LE), job id length and job id, nTime
+     * (8 bytes), extraNonce2 length and extraNonce2, then the solution. Turned
+     * into the params of a JSON submit, only the solution stays binary.
+     **/
+    function handleBinarySubmit(frame){
+        var jobIdEnd = 5 + (frame.length > 4 ? frame[4] : 0);
+        var nonceStart = jobIdEnd + 9;
+        if (frame.length < nonceStart || frame.length < nonceStart + frame[jobIdEnd + 8]){
+            _this.emit('malformedMessage', 'binary submit of ' + frame.length + ' bytes');
+            options.socket.destroy();
+            return false;
+        }
+        var nonceEnd = nonceStart + frame[jobIdEnd + 8];
+        handleSubmit({
+            id: frame.readUInt32LE(0),
+            params: [
+                _this.workerName,
+                frame.toString('utf8', 5, jobIdEnd),
+                frame.toString('hex', jobIdEnd, jobIdEnd + 8),
+                frame.toString('hex', nonceStart, nonceEnd),
+                frame.slice(nonceEnd)
+            ]
+        });
+        return true;
+    }
+
     function sendJson(){
         var response = '';
         for (var i = 0; i < arguments.length; i++){
@@ -198,13 +244,13 @@ var StratumClient = function(options){
 
     function setupSocket(){
         var socket = options.socket;
-        var dataBuffer = '';
-        socket.setEncoding('utf8');
+        // Kept as bytes, binary submit frames share the stream with JSON lines
+        var dataBuffer = new Buffer(0);
 
         if (options.tcpProxyProtocol === true) {
             socket.once('data', function (d) {
                 if (d.indexOf('PROXY') === 0) {
-                    _this.remoteAddress = d.split(' ')[2];
+                    _this.remoteAddress = d.toString('utf8').split(' ')[2];
                 }
                 else{
                     _this.emit('tcpProxyError', d);
@@ -216,35 +262,46 @@ var StratumClient = function(options){
             _this.emit('checkBan');
         }
         socket.on('data', function(d){
-            dataBuffer += d;
-            if (Buffer.byteLength(dataBuffer, 'utf8') > 10240){ //10KB
-                dataBuffer = '';
+            dataBuffer = dataBuffer.length ? Buffer.concat([dataBuffer, d]) : d;
+            if (dataBuffer.length > 10240){ //10KB
+                dataBuffer = new Buffer(0);
                 _this.emit('socketFlooded');
                 socket.destroy();
                 return;
             }
-            if (dataBuffer.indexOf('\n') !== -1){
-                var messages = dataBuffer.split('\n');
-                var incomplete = dataBuffer.slice(-1) === '\n' ? '' : messages.pop();
-                messages.forEach(function(message){
-                    if (message === '') return;
-                    var messageJson;
-                    try {
-                        messageJson = JSON.parse(message);
-                    } catch(e) {
-                        if (options.tcpProxyProtocol !== true || d.indexOf('PROXY') !== 0){
-                            _this.emit('malformedMessage', message);
-                            socket.destroy();
-                        }
+            var offset = 0;
+            while (offset < dataBuffer.length){
+                if (_this.binarySubmit && dataBuffer[offset] === BINARY_SUBMIT_MARKER){
+                    if (dataBuffer.length - offset < 3) break;
+                    var frameEnd = offset + 3 + dataBuffer.readUInt16LE(offset + 1);
+                    if (dataBuffer.length < frameEnd) break;
+                    var frame = dataBuffer.slice(offset + 3, frameEnd);
+                    offset = frameEnd;
+                    if (!handleBinarySubmit(frame)) return;
+                    continue;
+                }
+                var lineEnd = dataBuffer.indexOf(10, offset);
+                if (lineEnd === -1) break;
+                var message = dataBuffer.toString('utf8', offset, lineEnd);
+                offset = lineEnd + 1;
+                if (message === '') continue;
+                var messageJson;
+                try {
+                    messageJson = JSON.parse(message);
+                } catch(e) {
+                    if (options.tcpProxyProtocol !== true || d.indexOf('PROXY') !== 0){
+                        _this.emit('malformedMessage', message);
+                        socket.destroy();
                         return;
                     }
+                    continue;
+                }
 
-                    if (messageJson) {
-                        handleMessage(messageJson);
-                    }
-                });
-                dataBuffer = incomplete;
+                if (messageJson) {
+                    handleMessage(messageJson);
+                }
             }
+            dataBuffer = dataBuffer.slice(offset);
         });
         socket.on('close', function() {
             _this.emit('socketDisconnect');